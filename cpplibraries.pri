@@ -3,7 +3,24 @@ INCLUDEPATH += \
     $$PWD/qt/
 
 HEADERS += \
-    $$PWD/singleton.h
+    $$PWD/multiton.h \
+    $$PWD/sharded_singleton.h \
+    $$PWD/singleton.h \
+    $$PWD/singleton_arena.h \
+    $$PWD/singleton_profiler.h \
+    $$PWD/singleton_snapshot.h \
+    $$PWD/singleton_tracer.h \
+    $$PWD/thread_local_singleton.h
 
 SOURCES += \
-    $$PWD/singleton.cpp
+    $$PWD/singleton.cpp \
+    $$PWD/singleton_arena.cpp \
+    $$PWD/singleton_profiler.cpp \
+    $$PWD/singleton_snapshot.cpp \
+    $$PWD/singleton_tracer.cpp
+
+# Built on shm_open and mmap
+unix {
+    HEADERS += $$PWD/shared_memory_singleton.h
+    SOURCES += $$PWD/shared_memory_singleton.cpp
+}
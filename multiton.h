@@ -0,0 +1,420 @@
+/**
+ * @file multiton.h
+ * @author H1MSK (ksda47832338@outlook.com)
+ * @brief Singleton variant holding one instance per key
+ * @version 0.5
+ * @date 2022-06-26
+ */
+
+#ifndef MULTITON_H
+#define MULTITON_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include "singleton.h"
+
+/**
+ * @brief Multiton class keeping one instance of Type per key
+ *
+ * @tparam Key Type of the keys, copyable and equality comparable
+ * @tparam Type Type of the class
+ * @tparam Hash Hash function of Key
+ *
+ * Each key behaves like a @ref Singleton of its own: it's constructed once
+ * however many threads ask for it at the same time, and destructed on
+ * eviction. Instances are found through an open addressing table whose
+ * lookups take no lock and write no shared memory:
+ *
+ * ```cpp
+ * #include "multiton.h"
+ *
+ * class Tenant : public Multiton<std::string, Tenant> {
+ *  public:
+ *   explicit Tenant(const std::string &name);
+ * };
+ *
+ * Tenant::getOrCreateInstance("acme", "acme");
+ * Tenant::getInstance("acme")->...;
+ * if (auto tenant = Tenant::readInstance("acme")) tenant->...;
+ * Tenant::evict(std::vector<std::string>{"acme"});
+ * Tenant::destructAll();
+ * ```
+ *
+ * Keys stay in the table once added, only their instances are destructed, so
+ * a key evicted can be constructed again without taking a new slot.
+ */
+template <typename Key, typename Type, typename Hash = std::hash<Key>>
+class Multiton : public SingletonBase {
+  // A key in the table, never freed before the table
+  struct Entry : SingletonHeapStorage::Storage<Type> {
+    Entry(std::size_t hash, const Key &key) : hash(hash), key(key) {}
+
+    const std::size_t hash;
+    const Key key;
+    std::atomic<Type *> instance{nullptr};
+    SingletonState state;
+    // Thread running the constructor, to catch it asking for its own key
+    std::atomic<std::thread::id> builder{std::thread::id()};
+  };
+
+  // Open addressing index with linear probing, replaced by a twice larger
+  // one when half full. Readers may still be probing the old ones, so they're
+  // kept until the table is destructed.
+  struct Index {
+    explicit Index(std::size_t capacity)
+        : mask(capacity - 1), slots(new std::atomic<Entry *>[capacity]()) {}
+    ~Index() { delete[] slots; }
+
+    const std::size_t mask;
+    std::atomic<Entry *> *slots;
+    Index *previous = nullptr;
+  };
+
+  struct Table {
+    std::atomic<Index *> index{nullptr};
+    // Serializes the insertions of keys, lookups don't take it
+    std::mutex mutex;
+    std::vector<Entry *> entries;
+
+    static Table *Get() {
+      static Table table;
+      return &table;
+    }
+
+    ~Table() {
+      for (Entry *entry : entries) {
+        // If this line caused an assert failure, please call
+        // Type::destructAll() on exit
+        assert(entry->instance.load(std::memory_order_relaxed) == nullptr);
+        delete entry;
+      }
+      for (Index *current = index.load(std::memory_order_relaxed);
+           current != nullptr;) {
+        Index *previous = current->previous;
+        delete current;
+        current = previous;
+      }
+    }
+  };
+
+  // Lock of the table, counted as a transition so that fork waits for it and
+  // the child never inherits the mutex locked
+  class TableLock {
+   public:
+    explicit TableLock(Table *table) : m_table(table) {
+      SingletonFork::enter();
+      m_table->mutex.lock();
+    }
+    ~TableLock() {
+      m_table->mutex.unlock();
+      SingletonFork::leave();
+    }
+    TableLock(const TableLock &) = delete;
+    TableLock &operator=(const TableLock &) = delete;
+
+   private:
+    Table *m_table;
+  };
+
+ public:
+  /**
+   * @brief Create the instance of key, asserting it's not constructed
+   *
+   * @tparam ConstructorArguments Argument types for construction
+   * @param key Key of the instance
+   * @param args Arguments for construction, forwarded to the constructor
+   * @return Type* Pointer to the instance
+   */
+  template <typename... ConstructorArguments>
+  static Type *createInstance(const Key &key, ConstructorArguments &&...args) {
+    Entry *entry = insert(key);
+    SingletonTransition transition = begin(entry);
+    assert(transition.from() == SingletonState::kUninitialized);
+    return construct(transition, entry,
+                     std::forward<ConstructorArguments>(args)...);
+  }
+
+  /**
+   * @brief Get the instance of key, constructing it on need
+   *
+   * @tparam ConstructorArguments Argument types for construction
+   * @param key Key of the instance
+   * @param args Arguments for construction, only used by the thread
+   * constructing the instance
+   * @return Type* Pointer to the instance
+   *
+   * Threads asking for a key being constructed wait for the construction, so
+   * the constructor must not ask for its own key, which asserts.
+   */
+  template <typename... ConstructorArguments>
+  static Type *getOrCreateInstance(const Key &key,
+                                   ConstructorArguments &&...args) {
+    Entry *entry = find(key, Hash()(key));
+    if (entry != nullptr) {
+      Type *pointer = entry->instance.load(std::memory_order_acquire);
+      if (pointer != nullptr) return pointer;
+    } else {
+      entry = insert(key);
+    }
+    SingletonTransition transition = begin(entry);
+    if (transition.from() == SingletonState::kReady)
+      return entry->instance.load(std::memory_order_relaxed);
+    return construct(transition, entry,
+                     std::forward<ConstructorArguments>(args)...);
+  }
+
+  /**
+   * @brief Construct the instances of all the keys missing one
+   *
+   * @tparam Keys Range of keys
+   * @tparam ConstructorArguments Argument types for construction
+   * @param keys Keys to construct, like a std::vector<Key>
+   * @param args Arguments for construction, passed to every instance as
+   * lvalues
+   *
+   * The missing keys are added to the table at once, so the table grows at
+   * most once, then constructed in order.
+   */
+  template <typename Keys, typename... ConstructorArguments>
+  static void prefetch(const Keys &keys, const ConstructorArguments &...args) {
+    std::vector<Entry *> entries;
+    {
+      Table *table = Table::Get();
+      TableLock lock(table);
+      for (const Key &key : keys) entries.push_back(insertLocked(table, key));
+    }
+    for (Entry *entry : entries) {
+      if (entry->instance.load(std::memory_order_acquire) != nullptr)
+        continue;
+      SingletonTransition transition = begin(entry);
+      if (transition.from() == SingletonState::kReady) continue;
+      construct(transition, entry, args...);
+    }
+  }
+
+  /**
+   * @brief Get the instance of key, asserting it's constructed
+   */
+  static Type *getInstance(const Key &key) {
+    Type *pointer = tryGetInstance(key);
+    assert(pointer != nullptr);
+    return pointer;
+  }
+
+  /**
+   * @brief Get the instance of key if it's constructed
+   *
+   * @return Type* Pointer to the instance, or nullptr
+   */
+  static Type *tryGetInstance(const Key &key) {
+    Entry *entry = find(key, Hash()(key));
+    if (entry == nullptr) return nullptr;
+    return entry->instance.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Read section pinning the instance of a key, see
+   * @ref readInstance
+   */
+  using ReadGuard = SingletonReadGuard<Type>;
+
+  /**
+   * @brief Get the instance of key, kept alive until the guard goes out of
+   * scope, even if the key is evicted meanwhile
+   *
+   * @return ReadGuard Guard holding the instance, or nullptr if it's not
+   * constructed
+   */
+  static ReadGuard readInstance(const Key &key) {
+    return ReadGuard([&key]() -> const std::atomic<Type *> * {
+      Entry *entry = find(key, Hash()(key));
+      return entry != nullptr ? &entry->instance : nullptr;
+    });
+  }
+
+  /**
+   * @brief Destruct the instance of key
+   *
+   * @return true The instance was constructed
+   *
+   * Waits for the guards of @ref readInstance, so it must not be called
+   * holding one.
+   */
+  static bool destructInstance(const Key &key) {
+    Entry *entry = find(key, Hash()(key));
+    return entry != nullptr && evictEntries(&entry, 1) != 0;
+  }
+
+  /**
+   * @brief Destruct the instances of keys, the ones not constructed are
+   * skipped
+   *
+   * @tparam Keys Range of keys
+   * @return std::size_t Count of instances destructed
+   *
+   * All the instances are unpublished first, then destructed after a single
+   * wait for the guards of @ref readInstance, which must not be held by
+   * current thread.
+   */
+  template <typename Keys>
+  static std::size_t evict(const Keys &keys) {
+    std::vector<Entry *> entries;
+    for (const Key &key : keys) {
+      Entry *entry = find(key, Hash()(key));
+      if (entry != nullptr) entries.push_back(entry);
+    }
+    return evictEntries(entries.data(), entries.size());
+  }
+
+  /**
+   * @brief Destruct the instances of all the keys
+   *
+   * @return std::size_t Count of instances destructed
+   */
+  static std::size_t destructAll() {
+    std::vector<Entry *> entries;
+    {
+      Table *table = Table::Get();
+      TableLock lock(table);
+      entries = table->entries;
+    }
+    return evictEntries(entries.data(), entries.size());
+  }
+
+ private:
+  /**
+   * @brief Find the entry of key, without locking
+   */
+  static Entry *find(const Key &key, std::size_t hash) {
+    std::atomic<Index *> &current = Table::Get()->index;
+    for (;;) {
+      Index *index = current.load(std::memory_order_acquire);
+      if (index == nullptr) return nullptr;
+      for (std::size_t i = hash & index->mask;; i = (i + 1) & index->mask) {
+        Entry *entry = index->slots[i].load(std::memory_order_acquire);
+        if (entry == nullptr) break;
+        if (entry->hash == hash && entry->key == key) return entry;
+      }
+      // Missed, unless the key was added to a newer index meanwhile
+      if (current.load(std::memory_order_acquire) == index) return nullptr;
+    }
+  }
+
+  /**
+   * @brief Find the entry of key, adding it if missing
+   */
+  static Entry *insert(const Key &key) {
+    Table *table = Table::Get();
+    TableLock lock(table);
+    return insertLocked(table, key);
+  }
+
+  static Entry *insertLocked(Table *table, const Key &key) {
+    std::size_t hash = Hash()(key);
+    Entry *entry = find(key, hash);
+    if (entry != nullptr) return entry;
+    Index *index = table->index.load(std::memory_order_relaxed);
+    if (index == nullptr || (table->entries.size() + 1) * 2 > index->mask + 1)
+      index = grow(table, index);
+    entry = new Entry(hash, key);
+    table->entries.push_back(entry);
+    place(index, entry);
+    return entry;
+  }
+
+  /**
+   * @brief Publish a twice larger index holding all the entries
+   */
+  static Index *grow(Table *table, Index *index) {
+    Index *larger = new Index(index != nullptr ? (index->mask + 1) * 2 : 16);
+    for (Entry *entry : table->entries) place(larger, entry);
+    larger->previous = index;
+    table->index.store(larger, std::memory_order_release);
+    return larger;
+  }
+
+  static void place(Index *index, Entry *entry) {
+    std::size_t i = entry->hash & index->mask;
+    while (index->slots[i].load(std::memory_order_relaxed) != nullptr)
+      i = (i + 1) & index->mask;
+    index->slots[i].store(entry, std::memory_order_release);
+  }
+
+  /**
+   * @brief Start the construction transition of entry
+   */
+  static SingletonTransition begin(Entry *entry) {
+    // Asked for from its own constructor, which would wait for itself
+    assert(entry->builder.load(std::memory_order_relaxed) !=
+           std::this_thread::get_id());
+    return SingletonTransition(entry->state, SingletonState::kConstructing);
+  }
+
+  /**
+   * @brief Construct and publish the instance of entry, with transition of
+   * its state in progress
+   *
+   * The transition is committed to ready once the instance is published, so
+   * a post construction throwing leaves the instance constructed.
+   */
+  template <typename... ConstructorArguments>
+  static Type *construct(SingletonTransition &transition, Entry *entry,
+                         ConstructorArguments &&...args) {
+    Type *data = entry->allocate();
+    entry->builder.store(std::this_thread::get_id(),
+                         std::memory_order_relaxed);
+    SingletonLifetime::construct(
+        data,
+        [&](Type *data) {
+          new (data) Type(std::forward<ConstructorArguments>(args)...);
+        },
+        [entry](Type *data) {
+          entry->builder.store(std::thread::id(), std::memory_order_relaxed);
+          entry->deallocate(data);
+        });
+    // Pairs with the loads of SingletonReadGuard
+    entry->instance.store(data, std::memory_order_seq_cst);
+    entry->builder.store(std::thread::id(), std::memory_order_relaxed);
+    transition.commit(SingletonState::kReady);
+    SingletonPostConstructionHelper::pop();
+    return data;
+  }
+
+  /**
+   * @brief Unpublish the instances of entries, then destruct them once no
+   * reader holds them
+   */
+  static std::size_t evictEntries(Entry *const *entries, std::size_t count) {
+    std::vector<std::pair<Entry *, Type *>> evicted;
+    for (std::size_t i = 0; i < count; ++i) {
+      Entry *entry = entries[i];
+      SingletonTransition transition(entry->state,
+                                     SingletonState::kDestroying);
+      if (transition.from() != SingletonState::kReady) continue;
+      Type *pointer =
+          entry->instance.exchange(nullptr, std::memory_order_seq_cst);
+      evicted.push_back({entry, pointer});
+      // The key can be constructed again right away, in a new allocation
+      transition.commit(SingletonState::kUninitialized);
+    }
+    if (evicted.empty()) return 0;
+    SingletonEpoch::bump();
+    SingletonReclamation::synchronize();
+    for (auto &[entry, pointer] : evicted) {
+      SingletonLifetime::destruct(pointer);
+      entry->deallocate(pointer);
+    }
+    return evicted.size();
+  }
+};
+
+#endif  // MULTITON_H
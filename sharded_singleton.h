@@ -0,0 +1,243 @@
+/**
+ * @file sharded_singleton.h
+ * @author H1MSK (ksda47832338@outlook.com)
+ * @brief Singleton variant holding one instance per CPU or NUMA node
+ * @version 0.5
+ * @date 2022-06-26
+ */
+
+#ifndef SHARDED_SINGLETON_H
+#define SHARDED_SINGLETON_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <typeinfo>
+
+#include "singleton.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Shard selector giving each thread a fixed index
+ *
+ * Threads are numbered round robin on their first lookup, or bound to an
+ * index explicitly through @ref bind.
+ */
+struct ThreadShardSelector {
+  static std::size_t index() {
+    if (t_index == 0) t_index = s_next.fetch_add(1, std::memory_order_relaxed);
+    return t_index - 1;
+  }
+
+  /**
+   * @brief Bind current thread to a shard index
+   */
+  static void bind(std::size_t index) { t_index = index + 1; }
+
+ private:
+  // Stored plus one, so that 0 means unassigned
+  static inline thread_local std::size_t t_index = 0;
+  static inline std::atomic<std::size_t> s_next{1};
+};
+
+/**
+ * @brief Shard selector using the CPU current thread runs on
+ *
+ * Falls back to @ref ThreadShardSelector where the CPU can't be queried.
+ */
+struct CpuShardSelector {
+  static std::size_t index() {
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    if (cpu >= 0) return static_cast<std::size_t>(cpu);
+#endif
+    return ThreadShardSelector::index();
+  }
+};
+
+/**
+ * @brief Shard selector using the NUMA node current thread runs on
+ *
+ * Falls back to node 0 where the node can't be queried.
+ */
+struct NumaNodeShardSelector {
+  static std::size_t index() {
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+      return static_cast<std::size_t>(node);
+#endif
+    return 0;
+  }
+};
+
+/**
+ * @brief Storage of all shards, each on its own cache lines
+ *
+ * @tparam Type The class type
+ * @tparam Shards Count of shards
+ */
+template <typename Type, std::size_t Shards>
+struct ShardSet {
+  struct alignas(SINGLETON_CACHE_LINE_SIZE) Shard {
+    alignas(Type) unsigned char storage[sizeof(Type)];
+  };
+  Shard shards[Shards];
+
+  Type *get(std::size_t index) {
+    return std::launder(reinterpret_cast<Type *>(shards[index].storage));
+  }
+};
+
+/**
+ * @brief Singleton class keeping one instance per shard
+ *
+ * @tparam Type Type of the class
+ * @tparam Shards Count of shards, like the count of CPUs or NUMA nodes
+ * @tparam Selector Class providing static `std::size_t index()` for current
+ * thread, taken modulo Shards
+ *
+ * Suits counters and allocator-like states, which are updated from all cores
+ * but only read as a whole occasionally. All the shards are constructed and
+ * destructed together, and @ref getInstance resolves to the shard local to
+ * the calling thread:
+ *
+ * ```cpp
+ * #include "sharded_singleton.h"
+ *
+ * class Counter : public ShardedSingleton<Counter, 64> {
+ *  public:
+ *   std::atomic<long> value{0};
+ * };
+ *
+ * Counter::createInstance();
+ * Counter::getInstance()->value++;
+ * long total = 0;
+ * Counter::forEachShard([&](Counter *shard) { total += shard->value; });
+ * Counter::destructInstance();
+ * ```
+ *
+ * @note
+ * A thread may migrate between CPUs at any time, so the shard returned by
+ * @ref getInstance should still be accessed in a thread safe way.
+ */
+template <typename Type, std::size_t Shards,
+          typename Selector = CpuShardSelector>
+class ShardedSingleton : public SingletonBase {
+  static_assert(Shards > 0, "ShardedSingleton needs at least one shard");
+  using Set = ShardSet<Type, Shards>;
+
+ public:
+  /**
+   * @brief Create all the shards of Type
+   *
+   * @tparam ConstructorArguments Argument types for construction
+   * @param args Arguments for construction, passed to every shard as lvalues
+   */
+  template <typename... ConstructorArguments>
+  static void createInstance(const ConstructorArguments &...args) {
+    InstanceSafetyHelper<Set> *helper = InstanceSafetyHelper<Set>::Helper();
+    SingletonTransition transition(helper->state,
+                                   SingletonState::kConstructing);
+    assert(transition.from() == SingletonState::kUninitialized);
+    // Destructs the shards built before the one throwing, and leaves the
+    // helper as it was
+    struct Rollback {
+      InstanceSafetyHelper<Set> *helper;
+      Set *set;
+      std::size_t built = 0;
+      ~Rollback() {
+        if (set == nullptr) return;
+        helper->building.store(nullptr, std::memory_order_relaxed);
+        while (built > 0) {
+          Type *shard = set->get(--built);
+          SingletonPostConstructionHelper::abandon(shard);
+          shard->~Type();
+        }
+        delete set;
+      }
+    };
+    Set *set = new Set;
+    helper->building.store(set, std::memory_order_relaxed);
+    Rollback rollback{helper, set};
+    for (std::size_t i = 0; i < Shards; ++i) {
+      SingletonLifetime::construct(
+          reinterpret_cast<Type *>(set->shards[i].storage),
+          [&](Type *shard) { new (shard) Type(args...); }, [](Type *) {});
+      ++rollback.built;
+    }
+    rollback.set = nullptr;
+    helper->instance.store(set, std::memory_order_release);
+    helper->building.store(nullptr, std::memory_order_relaxed);
+    SingletonEpoch::bump();
+    // Ready before the post constructions, which may throw
+    transition.commit(SingletonState::kReady);
+    for (std::size_t i = 0; i < Shards; ++i)
+      SingletonPostConstructionHelper::pop();
+  }
+
+  /**
+   * @brief Destruct all the shards of Type
+   */
+  static void destructInstance() {
+    InstanceSafetyHelper<Set> *helper = InstanceSafetyHelper<Set>::Helper();
+    SingletonTransition transition(helper->state, SingletonState::kDestroying);
+    assert(transition.from() == SingletonState::kReady);
+    Set *set = helper->instance.load(std::memory_order_relaxed);
+    assert(set != nullptr);
+    helper->instance.store(nullptr, std::memory_order_release);
+    SingletonEpoch::bump();
+    for (std::size_t i = 0; i < Shards; ++i)
+      SingletonLifetime::destruct(set->get(i));
+    delete set;
+    transition.commit(SingletonState::kUninitialized);
+  }
+
+  /**
+   * @brief Get the shard local to current thread, asserting it's constructed
+   *
+   * @return Type* Pointer to the local shard
+   */
+  static Type *getInstance() { return getShard(Selector::index() % Shards); }
+
+  /**
+   * @brief Get the shard at index, asserting it's constructed
+   *
+   * @param index Index of the shard, less than Shards
+   * @return Type* Pointer to the shard
+   */
+  static Type *getShard(std::size_t index) {
+    assert(index < Shards);
+    Set *set = InstanceSafetyHelper<Set>::Helper()->instance.load(
+        std::memory_order_acquire);
+    assert(set != nullptr);
+    return set->get(index);
+  }
+
+  /**
+   * @brief Call function on every shard, mostly for reductions
+   *
+   * @tparam Function Callable type accepting Type*
+   * @param function Function to call
+   */
+  template <typename Function>
+  static void forEachShard(Function function) {
+    Set *set = InstanceSafetyHelper<Set>::Helper()->instance.load(
+        std::memory_order_acquire);
+    assert(set != nullptr);
+    for (std::size_t i = 0; i < Shards; ++i) function(set->get(i));
+  }
+
+  /**
+   * @brief Get the count of shards
+   */
+  static constexpr std::size_t shardCount() { return Shards; }
+};
+
+#endif  // SHARDED_SINGLETON_H
@@ -0,0 +1,230 @@
+#include "shared_memory_singleton.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <thread>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+struct SharedMemoryRegion::Control {
+  // SingletonState constants, 0 until the creator starts constructing
+  std::atomic<std::uint32_t> state;
+  // Count of processes attached, 0 once the last one detached
+  std::atomic<std::uint32_t> attached;
+  std::atomic<pid_t> creator;
+  std::uint64_t type_hash;
+  std::uint64_t size;
+};
+
+namespace {
+
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free,
+              "Shared state must be lock-free to work across processes");
+
+// Time the creator may take to size and claim a new region, before it's
+// taken for dead
+constexpr std::chrono::seconds kClaimTimeout{2};
+
+// The control block takes the first cache line, the instance starts on the
+// next boundary of its alignment
+std::size_t dataOffset(std::size_t alignment) {
+  return std::max<std::size_t>(alignment, 64);
+}
+
+std::uint64_t typeHash(const std::type_info &type, std::size_t size) {
+  return std::hash<std::string>()(type.name()) ^ size;
+}
+
+// Sleep until word changes from value, or for a while
+void waitFor(std::atomic<std::uint32_t> &word, std::uint32_t value) {
+#ifdef __linux__
+  timespec timeout{0, 100 * 1000 * 1000};
+  // Not private, the word is shared by processes
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAIT,
+          value, &timeout, nullptr, 0);
+#else
+  (void)word;
+  (void)value;
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+}
+
+void wakeAll(std::atomic<std::uint32_t> &word) {
+#ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAKE,
+          INT32_MAX, nullptr, nullptr, 0);
+#else
+  (void)word;
+#endif
+}
+
+}  // namespace
+
+SharedMemoryRegion::Role SharedMemoryRegion::open(const char *name,
+                                                  std::size_t size,
+                                                  std::size_t alignment,
+                                                  const std::type_info &type) {
+  static_assert(sizeof(Control) <= 64, "Control block overflows its line");
+  std::size_t offset = dataOffset(alignment);
+  std::size_t length = offset + size;
+  std::uint64_t hash = typeHash(type, size);
+  m_name = name;
+
+  for (;;) {
+    auto deadline = std::chrono::steady_clock::now() + kClaimTimeout;
+    bool created = true;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+      created = false;
+      fd = shm_open(name, O_RDWR, 0600);
+      // Removed by its last process meanwhile
+      if (fd < 0 && errno == ENOENT) continue;
+    }
+    if (fd < 0) {
+      perror("[SINGLETON] shm_open");
+      return Role::kFailed;
+    }
+
+    if (created) {
+      if (ftruncate(fd, length) != 0) {
+        perror("[SINGLETON] ftruncate");
+        ::close(fd);
+        shm_unlink(name);
+        return Role::kFailed;
+      }
+    } else {
+      // The creator may not have sized it yet
+      struct stat status;
+      for (;;) {
+        if (fstat(fd, &status) != 0) {
+          perror("[SINGLETON] fstat");
+          ::close(fd);
+          return Role::kFailed;
+        }
+        if (status.st_size != 0) break;
+        if (std::chrono::steady_clock::now() > deadline) {
+          fprintf(stderr, "[SINGLETON] Creator of %s died sizing it\n", name);
+          ::close(fd);
+          return Role::kFailed;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      if (static_cast<std::size_t>(status.st_size) != length) {
+        fprintf(stderr, "[SINGLETON] %s holds another type\n", name);
+        ::close(fd);
+        return Role::kFailed;
+      }
+    }
+    void *memory =
+        mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+      perror("[SINGLETON] mmap");
+      if (created) shm_unlink(name);
+      return Role::kFailed;
+    }
+    m_control = static_cast<Control *>(memory);
+    m_data = static_cast<unsigned char *>(memory) + offset;
+    m_length = length;
+
+    if (created) {
+      m_control->type_hash = hash;
+      m_control->size = size;
+      m_control->creator.store(getpid(), std::memory_order_relaxed);
+      m_control->attached.store(1, std::memory_order_relaxed);
+      m_control->state.store(SingletonState::kConstructing,
+                             std::memory_order_release);
+      return Role::kCreated;
+    }
+
+    std::uint32_t state;
+    while ((state = m_control->state.load(std::memory_order_acquire)) ==
+               SingletonState::kUninitialized ||
+           state == SingletonState::kConstructing) {
+      waitFor(m_control->state, state);
+      // The creator is stored before the state leaves kUninitialized
+      if (state == SingletonState::kUninitialized) {
+        if (std::chrono::steady_clock::now() <= deadline) continue;
+        fprintf(stderr, "[SINGLETON] Creator of %s died claiming it\n", name);
+        close(false);
+        return Role::kFailed;
+      }
+      pid_t creator = m_control->creator.load(std::memory_order_relaxed);
+      if (kill(creator, 0) != 0 && errno == ESRCH &&
+          m_control->state.load(std::memory_order_acquire) == state) {
+        fprintf(stderr, "[SINGLETON] Creator of %s died constructing it\n",
+                name);
+        close(false);
+        return Role::kFailed;
+      }
+    }
+    if (state != SingletonState::kReady) {
+      // Abandoned by its creator, or destructed by the last process, start
+      // over once it's removed
+      close(false);
+      std::this_thread::yield();
+      continue;
+    }
+    if (m_control->type_hash != hash || m_control->size != size) {
+      fprintf(stderr, "[SINGLETON] %s holds another type\n", name);
+      close(false);
+      return Role::kFailed;
+    }
+    std::uint32_t attached =
+        m_control->attached.load(std::memory_order_relaxed);
+    while (attached != 0 &&
+           !m_control->attached.compare_exchange_weak(
+               attached, attached + 1, std::memory_order_acq_rel)) {
+    }
+    if (attached != 0) return Role::kAttached;
+    // The last process detached meanwhile
+    close(false);
+    std::this_thread::yield();
+  }
+}
+
+void SharedMemoryRegion::publish() {
+  m_control->state.store(SingletonState::kReady, std::memory_order_release);
+  wakeAll(m_control->state);
+}
+
+void SharedMemoryRegion::abandon() {
+  m_control->attached.store(0, std::memory_order_relaxed);
+  m_control->state.store(SingletonState::kDestroying,
+                         std::memory_order_release);
+  wakeAll(m_control->state);
+}
+
+bool SharedMemoryRegion::detach() {
+  if (m_control->attached.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return false;
+  m_control->state.store(SingletonState::kDestroying,
+                         std::memory_order_release);
+  return true;
+}
+
+void SharedMemoryRegion::close(bool unlink) {
+  if (m_control == nullptr) return;
+  munmap(m_control, m_length);
+  m_control = nullptr;
+  m_data = nullptr;
+  if (unlink) shm_unlink(m_name.c_str());
+}
+
+bool SharedMemoryRegion::unlink(const char *name) {
+  return shm_unlink(name) == 0;
+}
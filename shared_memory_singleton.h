@@ -0,0 +1,231 @@
+/**
+ * @file shared_memory_singleton.h
+ * @author H1MSK (ksda47832338@outlook.com)
+ * @brief Singleton variant shared by all the processes of a machine
+ * @version 0.5
+ * @date 2022-06-26
+ */
+
+#ifndef SHARED_MEMORY_SINGLETON_H
+#define SHARED_MEMORY_SINGLETON_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+
+#include "singleton.h"
+
+/**
+ * @brief Named shared memory region holding one instance, with a lifetime
+ * state shared by all the processes attached to it
+ */
+class SharedMemoryRegion {
+ public:
+  enum class Role {
+    /// The region is new, the caller constructs the instance
+    kCreated,
+    /// The instance is constructed by another process
+    kAttached,
+    kFailed,
+  };
+
+  /**
+   * @brief Create the region name, or attach to it, waiting until its
+   * instance is constructed
+   *
+   * Fails if the process creating the region died before constructing the
+   * instance, or didn't size and claim the region within 2 seconds.
+   *
+   * @param name Name of the region, like "/rules", see shm_open
+   * @param size Size of the instance
+   * @param alignment Alignment of the instance
+   * @param type Type of the instance, checked against the existing region
+   */
+  Role open(const char *name, std::size_t size, std::size_t alignment,
+            const std::type_info &type);
+
+  void *data() const { return m_data; }
+
+  /**
+   * @brief Publish the instance constructed after @ref open returned
+   * kCreated, waking the processes waiting for it
+   */
+  void publish();
+
+  /**
+   * @brief Give up a construction that failed, the waiting processes start
+   * over and construct the instance themselves
+   */
+  void abandon();
+
+  /**
+   * @brief Detach from the region
+   *
+   * @return true The caller was the last process attached, and must destruct
+   * the instance before calling @ref close with unlink set
+   */
+  bool detach();
+
+  /**
+   * @brief Unmap the region, and remove its name if unlink is set
+   */
+  void close(bool unlink);
+
+  /**
+   * @brief Remove the region name, like the one left by crashed processes
+   */
+  static bool unlink(const char *name);
+
+ private:
+  struct Control;
+
+  Control *m_control = nullptr;
+  void *m_data = nullptr;
+  std::size_t m_length = 0;
+  std::string m_name;
+};
+
+/**
+ * @brief Singleton class whose instance is shared by all the processes
+ * attaching to the same name
+ *
+ * @tparam Type Type of the class
+ *
+ * The first process calling @ref createInstance constructs the instance in a
+ * shm_open region, the later ones map the same region and wait until the
+ * instance is constructed, so read-only data like lookup tables is resident
+ * once however many workers use it. The last process to call
+ * @ref destructInstance destructs the instance and removes the region.
+ *
+ * The region may be mapped at a different address in each process, so Type
+ * must keep all its data inline and hold no pointer, not even a vtable one.
+ * Members mutated after construction must be safe to share across processes,
+ * like lock-free atomics. There's no post construction.
+ *
+ * ```cpp
+ * #include "shared_memory_singleton.h"
+ *
+ * class Rules : public SharedMemorySingleton<Rules> {
+ *  public:
+ *   explicit Rules(const char *path);  // Compiles the rules in place
+ *   Rule table[4096];
+ * };
+ *
+ * // In every worker, before or after fork
+ * Rules::createInstance("/app-rules", "/etc/app/rules");
+ * Rules::getInstance()->table[0];
+ * ```
+ *
+ * Processes forked after attaching share the attachment of their parent and
+ * must not call @ref destructInstance themselves. A region left by crashed
+ * processes keeps its instance until removed with
+ * @ref SharedMemoryRegion::unlink.
+ */
+template <typename Type>
+class SharedMemorySingleton {
+ public:
+  /**
+   * @brief Attach to the instance of Type named name, constructing it if no
+   * process did
+   *
+   * @tparam ConstructorArguments Argument types for construction
+   * @param name Name of the region, like "/rules", see shm_open
+   * @param args Arguments for construction, only used by the process
+   * constructing the instance
+   * @return Type* Pointer to the instance in this process, or nullptr if the
+   * region can't be mapped, holds another type, or its creator died
+   */
+  template <typename... ConstructorArguments>
+  static Type *createInstance(const char *name,
+                              ConstructorArguments &&...args) {
+    static_assert(!std::is_polymorphic<Type>::value,
+                  "The vtable pointer is only valid in one process");
+    Local *local = Local::Get();
+    std::lock_guard<std::mutex> lock(local->mutex);
+    assert(local->instance.load(std::memory_order_relaxed) == nullptr);
+    SharedMemoryRegion::Role role =
+        local->region.open(name, sizeof(Type), alignof(Type), typeid(Type));
+    if (role == SharedMemoryRegion::Role::kFailed) return nullptr;
+    Type *data = static_cast<Type *>(local->region.data());
+    if (role == SharedMemoryRegion::Role::kCreated) {
+      SingletonLifetime::construct(
+          data,
+          [&](Type *data) {
+            new (data) Type(std::forward<ConstructorArguments>(args)...);
+          },
+          // Lets the waiting processes start over
+          [local](Type *) {
+            local->region.abandon();
+            local->region.close(true);
+          });
+      local->region.publish();
+    }
+    local->created = role == SharedMemoryRegion::Role::kCreated;
+    local->instance.store(data, std::memory_order_release);
+    return data;
+  }
+
+  /**
+   * @brief Detach from the instance of Type, destructing it in the last
+   * process attached
+   */
+  static void destructInstance() {
+    Local *local = Local::Get();
+    std::lock_guard<std::mutex> lock(local->mutex);
+    Type *pointer = local->instance.load(std::memory_order_relaxed);
+    assert(pointer != nullptr);
+    local->instance.store(nullptr, std::memory_order_release);
+    bool last = local->region.detach();
+    if (last) {
+      SingletonLifetime::destruct(pointer);
+    }
+    local->region.close(last);
+  }
+
+  /**
+   * @brief Get the instance of Type, asserting current process is attached
+   */
+  static Type *getInstance() {
+    Type *pointer = tryGetInstance();
+    assert(pointer != nullptr);
+    return pointer;
+  }
+
+  /**
+   * @brief Get the instance of Type if current process is attached
+   */
+  static Type *tryGetInstance() {
+    return Local::Get()->instance.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Whether the instance was constructed by current process
+   */
+  static bool createdHere() {
+    Local *local = Local::Get();
+    std::lock_guard<std::mutex> lock(local->mutex);
+    return local->created;
+  }
+
+ private:
+  // Attachment of current process
+  struct Local {
+    std::atomic<Type *> instance{nullptr};
+    std::mutex mutex;
+    SharedMemoryRegion region;
+    bool created = false;
+
+    static Local *Get() {
+      static Local local;
+      return &local;
+    }
+  };
+};
+
+#endif  // SHARED_MEMORY_SINGLETON_H
@@ -1,5 +1,629 @@
-#include "singleton.h"
+﻿#include "singleton.h"
 
-std::vector<SingletonBase *>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <string>
+#include <thread>
+
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+std::atomic<unsigned long> PointerWrapperCounting::s_failures;
+
+thread_local std::vector<SingletonBase *>
     SingletonPostConstructionHelper::s_classes_under_construction;
-int SingletonPostConstructionHelper::s_construct_stack_size;
+thread_local int SingletonPostConstructionHelper::s_construct_stack_size;
+
+// Starts from 1 so that zero-initialized thread_local caches are never valid
+std::atomic<unsigned long long> SingletonEpoch::s_epoch{1};
+
+std::atomic<SingletonReclamation::Slot *> SingletonReclamation::s_slots;
+
+std::atomic<SingletonHook *> SingletonHooks::s_hook;
+
+std::atomic<unsigned> SingletonFork::s_active;
+std::atomic<bool> SingletonFork::s_forking;
+std::atomic<SingletonFork::Entry *> SingletonFork::s_entries;
+std::mutex SingletonFork::s_mutex;
+
+struct SingletonReaper::State {
+  State() { s_state.store(this, std::memory_order_release); }
+  ~State() {
+    stop();
+    s_state.store(nullptr, std::memory_order_release);
+  }
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::thread thread;
+  bool stopping = false;
+};
+
+std::atomic<SingletonReaper::Entry *> SingletonReaper::s_entries;
+std::atomic<SingletonReaper::State *> SingletonReaper::s_state;
+
+std::atomic<SingletonExecutor::Executor> SingletonExecutor::s_executor{
+    [](std::function<void()> task) { std::thread(std::move(task)).detach(); }};
+
+std::mutex SingletonRegistry::s_mutex;
+std::vector<SingletonRegistry::Node> SingletonRegistry::s_nodes;
+std::size_t SingletonRegistry::s_exit_workers = 1;
+
+namespace {
+
+// Covers every fork of the program, even from static initializers running
+// later
+const bool s_fork_handlers = SingletonFork::install();
+
+/**
+ * @brief Run action on every node of an acyclic graph on a pool of threads,
+ * each node after all of its dependencies
+ *
+ * Once an action throws, no other node is started, and the first exception
+ * is rethrown after the actions in progress are done and the threads joined.
+ *
+ * @return std::vector<double> Seconds from the start to the start and to the
+ * end of each action, interleaved
+ */
+std::vector<double> runGraph(
+    const std::vector<std::vector<std::size_t>> &dependencies,
+    std::size_t workers, const std::function<void(std::size_t)> &action) {
+  const std::size_t count = dependencies.size();
+  std::vector<std::size_t> pending(count);
+  std::vector<std::vector<std::size_t>> dependents(count);
+  std::deque<std::size_t> ready;
+  for (std::size_t i = 0; i < count; ++i) {
+    pending[i] = dependencies[i].size();
+    for (std::size_t dependency : dependencies[i])
+      dependents[dependency].push_back(i);
+    if (pending[i] == 0) ready.push_back(i);
+  }
+
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point begin = Clock::now();
+  std::vector<double> times(count * 2);
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::size_t finished = 0;
+  std::exception_ptr error;
+
+  auto work = [&] {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      condition.wait(lock, [&] {
+        return !ready.empty() || finished == count || error != nullptr;
+      });
+      if (ready.empty() || error != nullptr) return;
+      std::size_t index = ready.front();
+      ready.pop_front();
+      lock.unlock();
+      Clock::time_point start = Clock::now();
+      std::exception_ptr failure;
+      try {
+        action(index);
+      } catch (...) {
+        failure = std::current_exception();
+      }
+      Clock::time_point end = Clock::now();
+      lock.lock();
+      if (failure != nullptr) {
+        if (error == nullptr) error = failure;
+        condition.notify_all();
+        return;
+      }
+      times[index * 2] = std::chrono::duration<double>(start - begin).count();
+      times[index * 2 + 1] = std::chrono::duration<double>(end - begin).count();
+      for (std::size_t dependent : dependents[index])
+        if (--pending[dependent] == 0) ready.push_back(dependent);
+      ++finished;
+      condition.notify_all();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < std::min(workers, count); ++i)
+    threads.emplace_back(work);
+  work();
+  for (auto &thread : threads) thread.join();
+  if (error != nullptr) std::rethrow_exception(error);
+  return times;
+}
+
+}  // namespace
+
+std::uint32_t SingletonState::begin(std::uint32_t transitional) {
+  std::uint32_t word = m_word.load(std::memory_order_relaxed);
+  for (;;) {
+    std::uint32_t state = word & kStateMask;
+    if (state == kUninitialized || state == kReady) {
+      if (m_word.compare_exchange_weak(word, transitional,
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed))
+        return state;
+      continue;
+    }
+    if (!(word & kWaiters) &&
+        !m_word.compare_exchange_weak(word, word | kWaiters,
+                                      std::memory_order_relaxed))
+      continue;
+    word |= kWaiters;
+#ifdef __linux__
+    static_assert(sizeof(m_word) == sizeof(std::uint32_t),
+                  "The futex must be the word itself");
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&m_word),
+            FUTEX_WAIT_PRIVATE, word, nullptr, nullptr, 0);
+#elif defined(__cpp_lib_atomic_wait)
+    m_word.wait(word, std::memory_order_relaxed);
+#else
+    std::this_thread::yield();
+#endif
+    word = m_word.load(std::memory_order_relaxed);
+  }
+}
+
+void SingletonState::end(std::uint32_t stable) {
+  if (!(m_word.exchange(stable, std::memory_order_release) & kWaiters)) return;
+#ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&m_word),
+          FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#elif defined(__cpp_lib_atomic_wait)
+  m_word.notify_all();
+#endif
+}
+
+SingletonReclamation::Slot *SingletonReclamation::acquireSlot() {
+  // Gives the slot back when the thread exits
+  static thread_local struct Owner {
+    Slot *slot = nullptr;
+    ~Owner() {
+      if (slot == nullptr) return;
+      t_slot = nullptr;
+      slot->owned.store(false, std::memory_order_release);
+    }
+  } owner;
+  Slot *slot = s_slots.load(std::memory_order_acquire);
+  for (; slot != nullptr; slot = slot->next) {
+    bool owned = false;
+    if (!slot->owned.load(std::memory_order_relaxed) &&
+        slot->owned.compare_exchange_strong(owned, true,
+                                            std::memory_order_acquire))
+      break;
+  }
+  if (slot == nullptr) {
+    slot = new Slot;
+    slot->owned.store(true, std::memory_order_relaxed);
+    slot->next = s_slots.load(std::memory_order_relaxed);
+    while (!s_slots.compare_exchange_weak(slot->next, slot,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+    }
+  }
+  owner.slot = slot;
+  t_slot = slot;
+  return slot;
+}
+
+void SingletonReclamation::synchronize() {
+  assert(t_depth == 0);
+  unsigned long long target = SingletonEpoch::current();
+  for (Slot *slot = s_slots.load(std::memory_order_acquire); slot != nullptr;
+       slot = slot->next) {
+    for (;;) {
+      unsigned long long epoch = slot->epoch.load(std::memory_order_seq_cst);
+      if (epoch == 0 || epoch >= target) break;
+      std::this_thread::yield();
+    }
+  }
+}
+
+void SingletonFork::join() {
+  for (;;) {
+    s_active.fetch_add(1, std::memory_order_seq_cst);
+    if (!s_forking.load(std::memory_order_seq_cst)) return;
+    // Let the fork go first
+    s_active.fetch_sub(1, std::memory_order_release);
+    while (s_forking.load(std::memory_order_acquire))
+      std::this_thread::yield();
+  }
+}
+
+void SingletonFork::track(Entry *entry) {
+  if (entry->tracked.exchange(true, std::memory_order_relaxed)) return;
+  entry->next = s_entries.load(std::memory_order_relaxed);
+  while (!s_entries.compare_exchange_weak(entry->next, entry,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+  }
+}
+
+bool SingletonFork::install() {
+#if defined(__unix__) || defined(__APPLE__)
+  return pthread_atfork(prepare, parent, child) == 0;
+#else
+  return false;
+#endif
+}
+
+void SingletonFork::prepare() {
+  // One fork at a time
+  s_mutex.lock();
+  s_forking.store(true, std::memory_order_seq_cst);
+  // Current thread may fork from a constructor
+  unsigned own = t_depth != 0 ? 1 : 0;
+  while (s_active.load(std::memory_order_seq_cst) != own)
+    std::this_thread::yield();
+  SingletonRegistry::s_mutex.lock();
+  SingletonReaper::lock();
+}
+
+void SingletonFork::parent() {
+  SingletonReaper::unlock();
+  SingletonRegistry::s_mutex.unlock();
+  s_forking.store(false, std::memory_order_release);
+  s_mutex.unlock();
+}
+
+void SingletonFork::child() {
+  SingletonReaper::restartInChild();
+  SingletonRegistry::s_mutex.unlock();
+  // Other threads may have been counted by join() while backing off, and are
+  // gone now
+  s_active.store(t_depth != 0 ? 1 : 0, std::memory_order_relaxed);
+  s_forking.store(false, std::memory_order_release);
+  s_mutex.unlock();
+  // Current thread is the only one left, the read sections of the others
+  // are over
+  using Slot = SingletonReclamation::Slot;
+  for (Slot *slot = SingletonReclamation::s_slots.load(
+           std::memory_order_acquire);
+       slot != nullptr; slot = slot->next) {
+    if (slot == SingletonReclamation::t_slot) continue;
+    slot->epoch.store(0, std::memory_order_relaxed);
+    slot->owned.store(false, std::memory_order_relaxed);
+  }
+  for (Entry *entry = s_entries.load(std::memory_order_acquire);
+       entry != nullptr; entry = entry->next)
+    entry->drop();
+  SingletonEpoch::bump();
+}
+
+SingletonReferenceCount::Record *SingletonReferenceCount::claim() {
+  Record *record = m_records.load(std::memory_order_acquire);
+  for (; record != nullptr; record = record->next) {
+    bool owned = false;
+    if (!record->owned.load(std::memory_order_relaxed) &&
+        record->owned.compare_exchange_strong(owned, true,
+                                              std::memory_order_acquire))
+      return record;
+  }
+  record = new Record;
+  record->owned.store(true, std::memory_order_relaxed);
+  record->next = m_records.load(std::memory_order_relaxed);
+  while (!m_records.compare_exchange_weak(record->next, record,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+  }
+  return record;
+}
+
+bool SingletonReferenceCount::idle() const {
+  for (Record *record = m_records.load(std::memory_order_acquire);
+       record != nullptr; record = record->next) {
+    if (record->count.load(std::memory_order_seq_cst) != 0) return false;
+  }
+  return true;
+}
+
+unsigned long SingletonReferenceCount::acquisitions() const {
+  unsigned long sum = 0;
+  for (Record *record = m_records.load(std::memory_order_acquire);
+       record != nullptr; record = record->next)
+    sum += record->acquisitions.load(std::memory_order_relaxed);
+  return sum;
+}
+
+SingletonReaper::State *SingletonReaper::state() {
+  // Constructed by the first instance watched, so destructed after the
+  // exit handlers of the instances
+  static State state;
+  return &state;
+}
+
+void SingletonReaper::track(Entry *entry) {
+  if (entry->tracked.exchange(true, std::memory_order_relaxed)) return;
+  entry->next = s_entries.load(std::memory_order_relaxed);
+  while (!s_entries.compare_exchange_weak(entry->next, entry,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+  }
+  State *reaper = state();
+  std::lock_guard<std::mutex> lock(reaper->mutex);
+  if (!reaper->thread.joinable() && !reaper->stopping)
+    reaper->thread = std::thread(run);
+}
+
+void SingletonReaper::stop() {
+  State *reaper = s_state.load(std::memory_order_acquire);
+  if (reaper == nullptr) return;
+  {
+    std::lock_guard<std::mutex> lock(reaper->mutex);
+    reaper->stopping = true;
+  }
+  reaper->condition.notify_all();
+  if (reaper->thread.joinable()) reaper->thread.join();
+}
+
+void SingletonReaper::run() {
+  using Clock = std::chrono::steady_clock;
+  State *reaper = state();
+  std::unique_lock<std::mutex> lock(reaper->mutex);
+  while (!reaper->stopping) {
+    lock.unlock();
+    // Each instance is checked a few times per idle delay
+    Clock::duration wait = std::chrono::seconds(1);
+    for (Entry *entry = s_entries.load(std::memory_order_acquire);
+         entry != nullptr; entry = entry->next) {
+      Clock::time_point now = Clock::now();
+      unsigned long seen = entry->acquisitions();
+      if (!entry->idle() || seen != entry->seen) {
+        entry->seen = seen;
+        entry->idle_since = now;
+      } else if (now - entry->idle_since >= entry->delay) {
+        entry->reap();
+        entry->idle_since = now;
+      }
+      wait = std::min<Clock::duration>(
+          wait, std::max<Clock::duration>(entry->delay / 4,
+                                          std::chrono::milliseconds(1)));
+    }
+    lock.lock();
+    if (!reaper->stopping) reaper->condition.wait_for(lock, wait);
+  }
+}
+
+void SingletonReaper::lock() {
+  if (State *reaper = s_state.load(std::memory_order_acquire))
+    reaper->mutex.lock();
+}
+
+void SingletonReaper::unlock() {
+  if (State *reaper = s_state.load(std::memory_order_acquire))
+    reaper->mutex.unlock();
+}
+
+void SingletonReaper::restartInChild() {
+  State *reaper = s_state.load(std::memory_order_acquire);
+  if (reaper == nullptr) return;
+  bool running = reaper->thread.joinable();
+  // The thread stayed in the parent, its handle is dropped without joining
+  new (&reaper->thread) std::thread;
+  if (running) reaper->thread = std::thread(run);
+  reaper->mutex.unlock();
+}
+
+void PointerWrapperAlwaysCheck::fail(const std::type_info &type) {
+  fprintf(stderr,
+          "[SINGLETON] %s used during its construction, see PointerWrapper\n",
+          SingletonRegistry::typeName(type).c_str());
+  std::abort();
+}
+
+std::string SingletonRegistry::typeName(const std::type_info &type) {
+#ifdef __GNUG__
+  int status;
+  char *name = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+  if (status == 0 && name != nullptr) {
+    std::string result(name);
+    free(name);
+    return result;
+  }
+#endif
+  return type.name();
+}
+
+std::size_t SingletonRegistry::addNode(const std::type_info &type,
+                                       Factory factory, Factory destroy,
+                                       bool (*constructed)(), bool *inserted) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  for (std::size_t i = 0; i < s_nodes.size(); ++i) {
+    if (*s_nodes[i].type == type) {
+      if (s_nodes[i].factory == nullptr) s_nodes[i].factory = factory;
+      *inserted = false;
+      return i;
+    }
+  }
+  s_nodes.push_back({&type, factory, destroy, constructed, {}, {}});
+  *inserted = true;
+  return s_nodes.size() - 1;
+}
+
+void SingletonRegistry::setDependencies(std::size_t index,
+                                        std::vector<std::size_t> dependencies) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  s_nodes[index].dependencies = std::move(dependencies);
+}
+
+void SingletonRegistry::addDestructBefore(std::size_t first,
+                                          std::size_t second) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  s_nodes[first].destruct_before.push_back(second);
+}
+
+bool SingletonRegistry::sortNodes(const std::vector<Node> &nodes,
+                                  std::vector<std::size_t> *order) {
+  enum class Mark { kNone, kVisiting, kDone };
+  std::vector<Mark> marks(nodes.size(), Mark::kNone);
+  // Depth first search, with the path kept for the cycle report
+  std::vector<std::pair<std::size_t, std::size_t>> path;
+  order->clear();
+  for (std::size_t root = 0; root < nodes.size(); ++root) {
+    if (marks[root] != Mark::kNone) continue;
+    marks[root] = Mark::kVisiting;
+    path.push_back({root, 0});
+    while (!path.empty()) {
+      auto &[index, next] = path.back();
+      if (next == nodes[index].dependencies.size()) {
+        marks[index] = Mark::kDone;
+        order->push_back(index);
+        path.pop_back();
+        continue;
+      }
+      std::size_t dependency = nodes[index].dependencies[next++];
+      if (marks[dependency] == Mark::kDone) continue;
+      if (marks[dependency] == Mark::kVisiting) {
+        std::string report;
+        bool in_cycle = false;
+        for (auto &step : path) {
+          if (step.first == dependency) in_cycle = true;
+          if (in_cycle) report += typeName(*nodes[step.first].type) + " -> ";
+        }
+        report += typeName(*nodes[dependency].type);
+        fprintf(stderr, "[SINGLETON] Dependency cycle: %s\n", report.c_str());
+        return false;
+      }
+      marks[dependency] = Mark::kVisiting;
+      path.push_back({dependency, 0});
+    }
+  }
+  return true;
+}
+
+bool SingletonRegistry::checkNodes(std::vector<Node> *nodes,
+                                   std::vector<std::size_t> *order) {
+  {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    *nodes = s_nodes;
+  }
+  if (!sortNodes(*nodes, order)) return false;
+  bool complete = true;
+  for (std::size_t index : *order) {
+    if ((*nodes)[index].factory == nullptr && !(*nodes)[index].constructed()) {
+      fprintf(stderr, "[SINGLETON] No factory for %s\n",
+              typeName(*(*nodes)[index].type).c_str());
+      complete = false;
+    }
+  }
+  return complete;
+}
+
+bool SingletonRegistry::createAll() {
+  std::vector<Node> nodes;
+  std::vector<std::size_t> order;
+  if (!checkNodes(&nodes, &order)) return false;
+  for (std::size_t index : order)
+    if (!nodes[index].constructed()) nodes[index].factory();
+  return true;
+}
+
+bool SingletonRegistry::createAllParallel(
+    std::size_t workers, std::vector<StartupStep> *critical_path) {
+  std::vector<Node> nodes;
+  std::vector<std::size_t> order;
+  if (!checkNodes(&nodes, &order)) return false;
+  if (workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+
+  std::vector<std::vector<std::size_t>> dependencies(nodes.size());
+  for (std::size_t i = 0; i < nodes.size(); ++i)
+    dependencies[i] = nodes[i].dependencies;
+  std::vector<double> times =
+      runGraph(dependencies, workers, [&](std::size_t index) {
+        if (!nodes[index].constructed()) nodes[index].factory();
+      });
+  std::vector<StartupStep> steps(nodes.size());
+  for (std::size_t i = 0; i < nodes.size(); ++i)
+    steps[i] = {typeName(*nodes[i].type), times[i * 2],
+                times[i * 2 + 1] - times[i * 2]};
+
+  if (critical_path != nullptr) {
+    // Longest chain of construction time, following dependencies
+    std::vector<double> length(nodes.size());
+    std::vector<std::size_t> previous(nodes.size(), nodes.size());
+    std::size_t last = nodes.size();
+    for (std::size_t index : order) {
+      length[index] = steps[index].duration;
+      for (std::size_t dependency : nodes[index].dependencies) {
+        if (length[dependency] + steps[index].duration > length[index]) {
+          length[index] = length[dependency] + steps[index].duration;
+          previous[index] = dependency;
+        }
+      }
+      if (last == nodes.size() || length[index] > length[last]) last = index;
+    }
+    critical_path->clear();
+    for (std::size_t index = last; index != nodes.size();
+         index = previous[index])
+      critical_path->push_back(steps[index]);
+    std::reverse(critical_path->begin(), critical_path->end());
+  }
+  return true;
+}
+
+void SingletonRegistry::printStartupSteps(
+    FILE *file, const std::vector<StartupStep> &steps) {
+  fprintf(file, "%12s %12s  %s\n", "start (ms)", "took (ms)", "singleton");
+  for (const StartupStep &step : steps)
+    fprintf(file, "%12.3f %12.3f  %s\n", step.start * 1e3, step.duration * 1e3,
+            step.name.c_str());
+}
+
+bool SingletonRegistry::destructAll(std::size_t workers) {
+  std::vector<Node> nodes;
+  {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    nodes = s_nodes;
+  }
+  // Reverse the edges, so that each node waits for the ones that must be
+  // destructed before it
+  std::vector<Node> teardown = nodes;
+  for (Node &node : teardown) node.dependencies.clear();
+  for (std::size_t i = 0; i < nodes.size(); ++i) {
+    for (std::size_t dependency : nodes[i].dependencies)
+      teardown[dependency].dependencies.push_back(i);
+    for (std::size_t later : nodes[i].destruct_before)
+      teardown[later].dependencies.push_back(i);
+  }
+  std::vector<std::size_t> order;
+  if (!sortNodes(teardown, &order)) return false;
+  if (workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+
+  auto destruct = [&](std::size_t index) {
+    if (nodes[index].constructed()) nodes[index].destroy();
+  };
+  if (workers <= 1) {
+    for (std::size_t index : order) destruct(index);
+  } else {
+    std::vector<std::vector<std::size_t>> dependencies(teardown.size());
+    for (std::size_t i = 0; i < teardown.size(); ++i)
+      dependencies[i] = teardown[i].dependencies;
+    runGraph(dependencies, workers, destruct);
+  }
+  return true;
+}
+
+void SingletonRegistry::destructAllAtExit(std::size_t workers) {
+  std::vector<Node> nodes;
+  {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    nodes = s_nodes;
+    s_exit_workers = workers;
+  }
+  // Make sure every InstanceSafetyHelper is constructed before the handler is
+  // registered, so that they are destructed after it runs
+  for (const Node &node : nodes) node.constructed();
+  std::atexit([] { destructAll(s_exit_workers); });
+}
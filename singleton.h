@@ -9,17 +9,116 @@
 #ifndef SINGLETON_H
 #define SINGLETON_H
 
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <future>
 #include <mutex>
+#include <new>
+#include <string>
 #include <type_traits>
+#include <tuple>
+#include <typeinfo>
+#include <utility>
 #include <vector>
 
+#ifndef SINGLETON_CACHE_LINE_SIZE
+/// Alignment used to keep instances from sharing cache lines with others
+#define SINGLETON_CACHE_LINE_SIZE 64
+#endif
+
+#if __cplusplus >= 202002L
+#define SINGLETON_UNLIKELY [[unlikely]]
+#else
+#define SINGLETON_UNLIKELY
+#endif
+
+#ifdef __GNUC__
+#define SINGLETON_COLD __attribute__((cold, noinline))
+#else
+#define SINGLETON_COLD
+#endif
+
+/**
+ * @brief Check policy of PointerWrapper doing nothing
+ */
+struct PointerWrapperUnchecked {
+  template <typename Type>
+  static void check(bool initialized) {
+    (void)initialized;
+  }
+};
+
+/**
+ * @brief Check policy of PointerWrapper asserting, so only in debug builds
+ */
+struct PointerWrapperDebugAssert {
+  template <typename Type>
+  static void check(bool initialized) {
+    // If this line caused an assert failure,
+    // that's mostly because you have a recursion reference in instantiation
+    // An example is in the documentation of PointerWrapper
+    assert(initialized == true);
+    (void)initialized;
+  }
+};
+
+/**
+ * @brief Check policy of PointerWrapper aborting with a report in all builds
+ *
+ * The check is a predicted branch, the report is kept out of line.
+ */
+struct PointerWrapperAlwaysCheck {
+  template <typename Type>
+  static void check(bool initialized) {
+    if (!initialized) SINGLETON_UNLIKELY fail(typeid(Type));
+  }
+
+  [[noreturn]] SINGLETON_COLD static void fail(const std::type_info &type);
+};
+
+/**
+ * @brief Check policy of PointerWrapper counting the failed checks, and
+ * carrying on with the pointer under construction
+ */
+struct PointerWrapperCounting {
+  template <typename Type>
+  static void check(bool initialized) {
+    if (!initialized) SINGLETON_UNLIKELY
+      s_failures.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  static unsigned long failures() {
+    return s_failures.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static std::atomic<unsigned long> s_failures;
+};
+
+#ifndef SINGLETON_POINTER_CHECK
+/// Default check policy of PointerWrapper and of
+/// SingletonDefaultTraits::pointer_check, define it the same way in every
+/// translation unit to change it
+#define SINGLETON_POINTER_CHECK PointerWrapperDebugAssert
+#endif
+
 /**
  * @brief Wrapper class for the instance to support lazy construct and recursion
  * reference detection
  *
  * @tparam Type The class type
+ * @tparam Check Policy checking the instance is constructed on each use, like
+ * @ref PointerWrapperUnchecked, @ref PointerWrapperDebugAssert,
+ * @ref PointerWrapperAlwaysCheck or @ref PointerWrapperCounting. Defaults to
+ * SINGLETON_POINTER_CHECK.
  *
  * An example of a recursion reference in instantiation:
  *
@@ -47,6 +146,10 @@
  * 3. (Most risky)call @ref Singleton::getInstanceDuringBuilding to get the
  * pointer
  *
+ * When the instance of A is only needed after construction, declaring A as a
+ * dependency of B, and constructing them through @ref SingletonRegistry,
+ * ensures A is built first.
+ *
  * Choosing solution 2, an adapted version of B is as follows:
  *
  * ```cpp
@@ -58,258 +161,1906 @@
  * };
  * ```
  */
-template <typename Type>
+template <typename Type, typename Check = SINGLETON_POINTER_CHECK>
 struct PointerWrapper {
   bool initialized;
   Type *raw_pointer;
 
   Type *operator->() {
-    // If this line caused an assert failure,
-    // that's mostly because you have a recursion reference in instantiation
-    // An example is above
-    assert(initialized == true);
+    Check::template check<Type>(initialized);
     return raw_pointer;
   }
   const Type *operator->() const {
-    // If this line caused an assert failure,
-    // that's mostly because you have a recursion reference in instantiation
-    // An example is above
-    assert(initialized == true);
+    Check::template check<Type>(initialized);
     return raw_pointer;
   }
 
   operator Type *() {
-    // If this line caused an assert failure,
-    // that's mostly because you have a recursion reference in instantiation
-    // An example is above
-    assert(initialized == true);
+    Check::template check<Type>(initialized);
     return raw_pointer;
   }
 };
 
 /**
- * @brief Class that actually stores the instance and the access mutex
- *
- * @tparam Type The type of the class
+ * @brief Behaviors of Singleton::getInstance while the instance is being
+ * constructed by Singleton::createInstanceAsync
  */
-template <typename Type>
-struct InstanceSafetyHelper {
-  PointerWrapper<Type> wrapper;
-  std::mutex mutex;
+struct SingletonAsyncPolicy {
+  /// Assert like an instance that's never constructed
+  static constexpr int kFailFast = 0;
+  /// Wait for the construction to finish
+  static constexpr int kBlock = 1;
+};
 
-  static InstanceSafetyHelper *Helper() {
-    static InstanceSafetyHelper<Type> helper;
-    return &helper;
-  }
-  InstanceSafetyHelper() : wrapper{false, nullptr}, mutex() {}
+/**
+ * @brief What becomes of an instance in the child process after fork(), see
+ * @ref SingletonFork
+ */
+struct SingletonForkPolicy {
+  /// The child keeps a copy of the instance
+  static constexpr int kKeep = 0;
+  /// The child drops the instance, and constructs a new one on the next
+  /// Singleton::getInstance
+  static constexpr int kRebuild = 1;
+  /// The child drops the instance, until Singleton::createInstance
+  static constexpr int kDrop = 2;
+};
 
-  ~InstanceSafetyHelper() {
-    // If this line caused an assert failure,
-    // please manually call Type::destructInstance() on exit
-    assert(wrapper.initialized == false && wrapper.raw_pointer == nullptr);
-  }
+/**
+ * @brief Storage policy allocating the instance on the heap
+ */
+struct SingletonHeapStorage {
+  template <typename Type>
+  struct Storage {
+    Type *allocate() {
+      return static_cast<Type *>(
+          ::operator new(sizeof(Type), std::align_val_t(alignof(Type))));
+    }
+    void deallocate(Type *pointer) {
+      ::operator delete(pointer, std::align_val_t(alignof(Type)));
+    }
+  };
 };
 
 /**
- * @brief Base singleton class declaring post construction interface
+ * @brief Storage policy keeping the instance inside its InstanceSafetyHelper
  *
+ * The storage is static, next to the pointer and the state guarding it, and
+ * padded to whole cache lines so it shares none with neighbouring globals.
  */
-class SingletonBase {
- public:
-  /**
-   * @brief Post construction interface
-   *
-   * This function will be called from all the constructed classes immediately
-   * after top instance call returns
-   */
-  virtual void postConstruction() {}
+struct SingletonInPlaceStorage {
+  template <typename Type>
+  struct alignas(SINGLETON_CACHE_LINE_SIZE) Storage {
+    alignas(Type) unsigned char storage[sizeof(Type)];
+
+    Type *allocate() { return reinterpret_cast<Type *>(storage); }
+    void deallocate(Type *) {}
+  };
 };
 
 /**
- * @brief Helper class for post construction calls
- *
- * @todo Maybe this can be achieved by template metaprogramming?
+ * @brief Default options of Singleton
  */
-class SingletonPostConstructionHelper {
- public:
-  static void push(SingletonBase *pointer) {
-    s_construct_stack_size++;
-    s_classes_under_construction.push_back(pointer);
-  }
-  static void pop() {
-    assert(s_construct_stack_size > 0);
-    if (!--s_construct_stack_size) {
-      for (auto ptr : s_classes_under_construction) ptr->postConstruction();
-      s_classes_under_construction.clear();
-    }
-  }
+struct SingletonDefaultTraits {
+  /**
+   * @brief Cache the instance pointer in a thread_local slot
+   *
+   * When enabled, @ref Singleton::getInstance skips the function-local static
+   * of @ref InstanceSafetyHelper after the first lookup in each thread. The
+   * cached pointer is validated against @ref SingletonTypeEpoch, which only
+   * changes when the instance of this type is published or unpublished.
+   */
+  static constexpr bool thread_cached = false;
 
- private:
-  static std::vector<SingletonBase *> s_classes_under_construction;
-  static int s_construct_stack_size;
+  /**
+   * @brief Behavior of @ref Singleton::getInstance while an asynchronous
+   * construction is in flight, see @ref SingletonAsyncPolicy
+   */
+  static constexpr int async_policy = SingletonAsyncPolicy::kFailFast;
+
+  /**
+   * @brief Where the instance is stored, like @ref SingletonHeapStorage or
+   * @ref SingletonInPlaceStorage
+   */
+  using storage = SingletonHeapStorage;
+
+  /**
+   * @brief Policy checking the instance is constructed on each use of the
+   * @ref PointerWrapper returned by Singleton, like
+   * @ref PointerWrapperAlwaysCheck
+   *
+   * Prefer it to SINGLETON_POINTER_CHECK for a single type, the macro has to
+   * be defined the same way in every translation unit.
+   */
+  using pointer_check = SINGLETON_POINTER_CHECK;
+
+  /**
+   * @brief Make @ref Singleton::destructInstance wait for the readers of
+   * @ref Singleton::readInstance
+   *
+   * When enabled, the instance is unpublished first, then destructed once the
+   * guards taken before are released, so a guard never sees a destructed
+   * instance. Readers pay nothing more for it, see @ref SingletonReclamation.
+   * Note the instance is no longer reachable while its destructor runs.
+   */
+  static constexpr bool guarded_access = false;
+
+  /**
+   * @brief Version of the snapshot image of the instance, 0 to disable
+   *
+   * When not 0, @ref Singleton::createInstance restores the instance from
+   * its image through the constructor `Type(const SingletonSnapshotView &)`
+   * if a valid one is found, see singleton_snapshot.h. Bump it whenever the
+   * layout written by @ref SingletonBase::saveSnapshot changes.
+   */
+  static constexpr unsigned snapshot_version = 0;
+
+  /**
+   * @brief Keep the instance in constant-initialized storage when Type allows
+   *
+   * Applies to the types that are trivially destructible, constexpr default
+   * constructible, don't override @ref SingletonBase::postConstruction and
+   * don't use snapshots. Their instance exists for the whole program, before
+   * any dynamic initialization: @ref Singleton::getInstance takes the address
+   * of a global, and @ref Singleton::createInstance and
+   * @ref Singleton::destructInstance do nothing. So the instance is never
+   * reset, and createInstance takes no arguments. No hook is reported for
+   * them.
+   */
+  static constexpr bool constant_initialized = false;
+
+  /**
+   * @brief What becomes of the instance in the child process after fork(),
+   * see @ref SingletonForkPolicy
+   *
+   * A dropped instance is unpublished without running its destructor, as the
+   * threads and the locks it owns stayed in the parent. A rebuilt one is
+   * default constructed.
+   */
+  static constexpr int fork_policy = SingletonForkPolicy::kKeep;
+
+  /**
+   * @brief Count the handles of @ref Singleton::acquire, and destruct the
+   * instance once none is left
+   *
+   * The first acquire constructs the instance. Once the last handle is
+   * released, the instance stays parked for @ref idle_milliseconds, then is
+   * destructed by @ref SingletonReaper, and the next acquire constructs it
+   * again. Handles are counted per thread, see @ref SingletonReferenceCount.
+   */
+  static constexpr bool reference_counted = false;
+
+  /**
+   * @brief How long a reference counted instance is parked without any
+   * handle before it's destructed, 0 to destruct it on the last release
+   */
+  static constexpr unsigned idle_milliseconds = 1000;
 };
 
 /**
- * @brief Singleton class implementing Instance and getInstance static functions
+ * @brief Per-type options of Singleton
  *
- * @tparam Type Type of the class
+ * @tparam Type The class type
  *
- * To apply singleton pattern on a class A, just let it inherit Singleton<A>.
+ * Specialize it to change the options of a type, inheriting
+ * @ref SingletonDefaultTraits keeps the options not mentioned:
  *
- * Here's a short example:
  * ```cpp
- * #include "singleton.h"
- *
- * class A : public Singleton<A> {
- *   //...
+ * template <>
+ * struct SingletonTraits<A> : SingletonDefaultTraits {
+ *   static constexpr bool thread_cached = true;
  * };
- *
- * int main() {
- *   A* a = A::createInstance();
- *   //a->...
- *   A::destructInstance();
- *   return 0;
- * }
  * ```
  */
 template <typename Type>
-class Singleton : public SingletonBase {
+struct SingletonTraits : SingletonDefaultTraits {};
+
+/**
+ * @brief Type, made dependent on Deferred
+ */
+template <typename Type, typename... Deferred>
+struct SingletonDeferred {
+  using type = Type;
+};
+
+/**
+ * @brief Wrapper of the instance returned by Singleton, checked by the
+ * pointer_check of its traits
+ *
+ * @tparam Deferred Template parameters of the member returning it. They
+ * delay reading the traits until the member is used, so the traits may be
+ * specialized after the class deriving from Singleton.
+ */
+template <typename Type, typename... Deferred>
+using SingletonPointerWrapper = PointerWrapper<
+    Type, typename SingletonTraits<typename SingletonDeferred<
+              Type, Deferred...>::type>::pointer_check>;
+
+/**
+ * @brief Lifetime state of an instance in a 4 byte word, doubling as the lock
+ * of its construction and destruction
+ *
+ * A transition, like constructing, is started from a stable state, like
+ * uninitialized, and excludes any other transition until it ends. Threads
+ * starting a transition while another one is in progress sleep on the word,
+ * with a futex on Linux, until it ends.
+ */
+class SingletonState {
  public:
+  static constexpr std::uint32_t kUninitialized = 0;
+  static constexpr std::uint32_t kConstructing = 1;
+  static constexpr std::uint32_t kReady = 2;
+  static constexpr std::uint32_t kDestroying = 3;
+
+  constexpr SingletonState() : m_word(kUninitialized) {}
+
+  std::uint32_t load() const {
+    return m_word.load(std::memory_order_acquire) & kStateMask;
+  }
+
   /**
-   * @brief Get the instance of Type, or construct it on need
-   *
-   * @tparam ConstructorArguments Argument types for construction
-   * @param args Arguments for construction
-   * @return PointerWrapper<Type> Pointer wrapper class of type, can be used as
-   * raw pointer
+   * @brief Start a transition, waiting for the one in progress if any
    *
-   * @deprecated User should separate creation logic from instance obtaining
+   * @param transitional kConstructing or kDestroying
+   * @return std::uint32_t The stable state the transition starts from
    */
-  template <typename... ConstructorArguments>
-  [[deprecated]] static PointerWrapper<Type> Instance(
-      ConstructorArguments... args) {
-    InstanceSafetyHelper<Type> *helper = InstanceSafetyHelper<Type>::Helper();
-    extern SingletonPostConstructionHelper s_singleton_post_construction_helper;
-    if (helper->wrapper.raw_pointer == nullptr) {
-      helper->mutex.lock();
-      if (helper->wrapper.raw_pointer == nullptr) {
-        Type *data = reinterpret_cast<Type *>(malloc(sizeof(Type)));
-        helper->wrapper.raw_pointer = data;
-        s_singleton_post_construction_helper.push(data);
-        helper->wrapper.raw_pointer = new (data) Type(args...);
-        fprintf(stderr, "[SINGLETON] Constructed pointer at 0x%08p\n",
-                helper->wrapper.raw_pointer);
-        helper->wrapper.initialized = true;
-        s_singleton_post_construction_helper.pop();
-      }
-      helper->mutex.unlock();
-    }
-    return helper->wrapper;
-  }
+  std::uint32_t begin(std::uint32_t transitional);
 
   /**
-   * @brief Create the instance of Type, returning its pointer
+   * @brief End the transition in progress, waking the threads waiting for it
    *
-   * @tparam ConstructorArguments Argument types for construction
-   * @param args Arguments for construction
-   * @return PointerWrapper<Type> Pointer wrapper class of type, can be used as
-   * raw pointer
+   * @param stable kUninitialized or kReady
    */
-  template <typename... ConstructorArguments>
-  static PointerWrapper<Type> createInstance(ConstructorArguments... args) {
-    InstanceSafetyHelper<Type> *helper = InstanceSafetyHelper<Type>::Helper();
-    extern SingletonPostConstructionHelper s_singleton_post_construction_helper;
-    assert(helper->wrapper.raw_pointer == nullptr);
-    helper->mutex.lock();
-    assert(helper->wrapper.raw_pointer == nullptr);
-    Type *data = reinterpret_cast<Type *>(malloc(sizeof(Type)));
-    helper->wrapper.raw_pointer = data;
-    s_singleton_post_construction_helper.push(data);
-    helper->wrapper.raw_pointer = new (data) Type(args...);
-    fprintf(stderr, "[SINGLETON] Constructed pointer at 0x%08p\n",
-            helper->wrapper.raw_pointer);
-    helper->wrapper.initialized = true;
-    s_singleton_post_construction_helper.pop();
-    helper->mutex.unlock();
-    return helper->wrapper;
-  }
-
-  //  template <typename Other>
-  //  static std::enable_if_t<std::is_base_of_v<Singleton, Other>, void>
-  //  setDestructBefore() {
-  //    // TODO: destruction helper InstanceSafetyHelper
-  //    // UNIMPLEMENTED!!
-  //    assert(false);
-  //  }
+  void end(std::uint32_t stable);
+
+ private:
+  static constexpr std::uint32_t kStateMask = 3;
+  // Set by the threads waiting for the transition in progress
+  static constexpr std::uint32_t kWaiters = 4;
+
+  std::atomic<std::uint32_t> m_word;
+};
 
+/**
+ * @brief Fork handlers keeping the singletons consistent across fork()
+ *
+ * Installed with pthread_atfork before main. Before fork, new constructions
+ * and destructions are held back and the ones in progress on other threads
+ * are waited for, so the child never inherits a transition, a registry lock
+ * or a read section whose thread is gone. In the child, the instances are
+ * kept or dropped according to @ref SingletonDefaultTraits::fork_policy.
+ *
+ * A construction running on another thread delays fork until it's done.
+ * Forking from a constructor works, the chain of current thread carries on in
+ * both processes.
+ *
+ * Locks taken outside constructions and destructions aren't held back, so a
+ * fork while another thread holds one leaves it locked in the child: the
+ * callback list of @ref Singleton::createInstanceAsync, the registry of
+ * ThreadLocalSingleton, and the configuration and queries of SingletonArena.
+ * The arena allocations themselves are within constructions. Don't fork
+ * concurrently with those, or only exec in the child.
+ */
+class SingletonFork {
+ public:
   /**
-   * @brief Destruct the instance of Type
+   * @brief Node of the list of the types not kept in the child
    */
-  static void destructInstance() {
-    InstanceSafetyHelper<Type> *helper = InstanceSafetyHelper<Type>::Helper();
-    assert(helper->wrapper.raw_pointer != nullptr &&
-           helper->wrapper.initialized);
-
-    // This will call Singleton<Type>::~Singleton, in which the wrapper will be
-    // reset
-    //
-    delete helper->wrapper.raw_pointer;
-  }
+  struct Entry {
+    // Unpublishes the instance, in the child
+    void (*drop)();
+    // Set in the child once the instance is dropped
+    bool dropped;
+    std::atomic<bool> tracked;
+    Entry *next;
+  };
 
   /**
-   * @brief Get the instance of Type, asserting it's constructed
-   *
-   * @return Type* Pointer to the instance of Type
-   *
-   * @note
-   * When this function asserts failed, there are two situations:
-   * 1. You are trying to get the instance before calling @ref
-   * Singleton::createInstance,
-   * 2. You are trying to use the instance of Type during its construction
+   * @brief Enter a construction or destruction, they can nest
    *
-   * @note
-   * For the first scenario, please construct it before using;
-   * For the second one, please refer to @ref PointerWrapper for solution.
+   * Waits while a fork is being prepared by another thread.
    */
-  static Type *getInstance() {
-    InstanceSafetyHelper<Type> *helper = InstanceSafetyHelper<Type>::Helper();
-    assert(helper->wrapper.raw_pointer != nullptr &&
-           helper->wrapper.initialized);
-    return helper->wrapper.raw_pointer;
+  static void enter() {
+    if (t_depth++ == 0) join();
   }
 
   /**
-   * @brief Get the instance of Type during its construction
-   *
-   * @return Type* Pointer to the instance of Type
-   *
-   * @deprecated Use of instance during its construction is always risky, and
-   * will very likely to cause instability / crash of the program, so use at
-   * your own risk
+   * @brief Leave a construction or destruction
    */
-  [[deprecated]] static Type *getInstanceDuringBuilding() {
-    InstanceSafetyHelper<Type> *helper = InstanceSafetyHelper<Type>::Helper();
-    assert(helper->wrapper.raw_pointer != nullptr &&
-           !helper->wrapper.initialized);
-    return helper->wrapper.raw_pointer;
+  static void leave() {
+    assert(t_depth > 0);
+    if (--t_depth == 0) s_active.fetch_sub(1, std::memory_order_release);
   }
 
   /**
-   * @brief Destroy the instance of Type, and update its InstanceSafetyHelper
-   * to avoid multiple deletion / memory leak
+   * @brief Add the type of entry to the list handled in the child, once
    */
-  ~Singleton() {
-    InstanceSafetyHelper<Type> *helper = InstanceSafetyHelper<Type>::Helper();
-    assert(helper->wrapper.initialized);
-    helper->mutex.lock();
-    // If this line caused an assertion fail, you are probably trying to
-    // construct a new instance while destroying the old one
-    // It's mostly because you are using Singleton::Instace if it's not intended
-    assert(helper->wrapper.initialized);
-    helper->wrapper.initialized = false;
-    helper->wrapper.raw_pointer = nullptr;
-    helper->mutex.unlock();
+  static void track(Entry *entry);
+
+  /**
+   * @brief Register the fork handlers, done before main
+   */
+  static bool install();
+
+ private:
+  static void join();
+  static void prepare();
+  static void parent();
+  static void child();
+
+  // Threads in a construction or destruction
+  static std::atomic<unsigned> s_active;
+  static std::atomic<bool> s_forking;
+  // Entries are never removed, like the types they stand for
+  static std::atomic<Entry *> s_entries;
+  static std::mutex s_mutex;
+  static inline thread_local unsigned t_depth = 0;
+};
+
+/**
+ * @brief Scoped transition of a @ref SingletonState
+ *
+ * Ends in the state it started from, unless @ref commit is called, so a
+ * transition interrupted by an exception leaves the state unchanged.
+ */
+class SingletonTransition {
+ public:
+  SingletonTransition(SingletonState &state, std::uint32_t transitional)
+      : m_state(state), m_from(start(state, transitional)), m_to(m_from) {}
+  ~SingletonTransition() {
+    m_state.end(m_to);
+    SingletonFork::leave();
+  }
+  SingletonTransition(const SingletonTransition &) = delete;
+  SingletonTransition &operator=(const SingletonTransition &) = delete;
+
+  std::uint32_t from() const { return m_from; }
+  void commit(std::uint32_t stable) { m_to = stable; }
+
+ private:
+  // Held back while a fork is being prepared, see SingletonFork
+  static std::uint32_t start(SingletonState &state,
+                             std::uint32_t transitional) {
+    SingletonFork::enter();
+    return state.begin(transitional);
+  }
+
+  SingletonState &m_state;
+  std::uint32_t m_from;
+  std::uint32_t m_to;
+};
+
+/**
+ * @brief Class that actually stores the instance and its lifetime state
+ *
+ * @tparam Type The type of the class
+ *
+ * The instance pointer is only published to @ref instance after construction
+ * finishes, with release semantics, so readers can take it with a single
+ * acquire load. The state is only changed when constructing or destructing,
+ * see @ref SingletonState.
+ *
+ * The memory of the instance comes from the storage policy of the type, see
+ * @ref SingletonDefaultTraits::storage
+ */
+template <typename Type>
+struct InstanceSafetyHelper
+    : SingletonTraits<Type>::storage::template Storage<Type> {
+  std::atomic<Type *> instance;
+  std::atomic<Type *> building;
+  SingletonState state;
+
+  static InstanceSafetyHelper *Helper() {
+    static InstanceSafetyHelper<Type> helper;
+    return &helper;
+  }
+  InstanceSafetyHelper() : instance(nullptr), building(nullptr), state() {}
+
+  SingletonPointerWrapper<Type> wrapper() const {
+    Type *pointer = instance.load(std::memory_order_acquire);
+    if (pointer != nullptr) return {true, pointer};
+    return {false, building.load(std::memory_order_relaxed)};
+  }
+
+  ~InstanceSafetyHelper() {
+    // If this line caused an assert failure,
+    // please manually call Type::destructInstance() on exit, or use
+    // SingletonRegistry::destructAll
+    assert(instance.load(std::memory_order_relaxed) == nullptr &&
+           building.load(std::memory_order_relaxed) == nullptr &&
+           state.load() == SingletonState::kUninitialized);
   }
 };
 
+/**
+ * @brief Executor of the asynchronous constructions
+ *
+ * Runs each task on a new detached thread unless replaced by
+ * @ref setExecutor, like to post the tasks to a thread pool.
+ */
+class SingletonExecutor {
+ public:
+  using Executor = void (*)(std::function<void()> task);
+
+  static void post(std::function<void()> task) {
+    s_executor.load(std::memory_order_acquire)(std::move(task));
+  }
+  static void setExecutor(Executor executor) {
+    s_executor.store(executor, std::memory_order_release);
+  }
+
+ private:
+  static std::atomic<Executor> s_executor;
+};
+
+/**
+ * @brief State of the asynchronous construction of a singleton
+ *
+ * @tparam Type The class type
+ *
+ * Kept apart from @ref InstanceSafetyHelper, so that only the types ever
+ * constructed asynchronously pay for it
+ */
+template <typename Type>
+struct AsyncConstructionState {
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool in_flight = false;
+  std::vector<std::function<void(Type *)>> callbacks;
+
+  static AsyncConstructionState *Get() {
+    static AsyncConstructionState<Type> state;
+    return &state;
+  }
+};
+
+/**
+ * @brief Lifetime events of singletons, reported to @ref SingletonHook
+ */
+enum class SingletonEvent {
+  kConstructBegin,
+  kConstructEnd,
+  kPostConstructionBegin,
+  kPostConstructionEnd,
+  kDestructBegin,
+  kDestructEnd,
+  /// The construction begun last on the thread threw, so it has no end
+  kConstructAbort,
+  /// The post construction begun last on the thread threw, so it has no end
+  kPostConstructionAbort,
+  /// The instance didn't fit in SingletonArena and is allocated on the heap
+  kArenaOverflow,
+  /// The snapshot image of the type is invalid and ignored, without instance
+  kSnapshotRejected,
+};
+
+/**
+ * @brief Interface receiving the lifetime events of all singletons
+ *
+ * Events are reported to the hook installed at run time. Without one, each
+ * event costs a load and a branch, on the construction and destruction paths
+ * only. Construction events are reported while the construction is in
+ * progress, so hooks should be quick.
+ */
+class SingletonHook {
+ public:
+  virtual ~SingletonHook() = default;
+  /**
+   * @brief Called on every event
+   *
+   * @param event The event
+   * @param type Type of the singleton
+   * @param instance The instance, possibly not or no longer constructed
+   */
+  virtual void onEvent(SingletonEvent event, const std::type_info &type,
+                       const void *instance) = 0;
+};
+
+/**
+ * @brief Holder of the installed @ref SingletonHook
+ */
+class SingletonHooks {
+ public:
+  /**
+   * @brief Install hook, or uninstall with nullptr
+   *
+   * @return SingletonHook* The hook previously installed, which a new hook
+   * may forward events to
+   */
+  static SingletonHook *install(SingletonHook *hook) {
+    return s_hook.exchange(hook, std::memory_order_acq_rel);
+  }
+  static void emit(SingletonEvent event, const std::type_info &type,
+                   const void *instance) {
+    SingletonHook *hook = s_hook.load(std::memory_order_acquire);
+    if (hook != nullptr) SINGLETON_UNLIKELY
+      hook->onEvent(event, type, instance);
+  }
+
+ private:
+  static std::atomic<SingletonHook *> s_hook;
+};
+
+#define SINGLETON_HOOK(event, type, instance) \
+  SingletonHooks::emit(SingletonEvent::event, type, instance)
+
+/**
+ * @brief Global counter bumped on every singleton construction and destruction
+ *
+ * Used by @ref SingletonReclamation to tell the read sections entered before
+ * an instance was unpublished
+ */
+class SingletonEpoch {
+ public:
+  static unsigned long long current() {
+    return s_epoch.load(std::memory_order_acquire);
+  }
+  static void bump() { s_epoch.fetch_add(1, std::memory_order_release); }
+
+ private:
+  static std::atomic<unsigned long long> s_epoch;
+};
+
+/**
+ * @brief Counter bumped whenever the instance of Type is published or
+ * unpublished
+ *
+ * Used to invalidate the thread_local pointer caches of Type, see
+ * @ref SingletonDefaultTraits::thread_cached. Constant-initialized, so it's
+ * read without the guard of a function-local static.
+ */
+template <typename Type>
+class SingletonTypeEpoch {
+ public:
+  static unsigned long long current() {
+    return s_epoch.load(std::memory_order_acquire);
+  }
+  static void bump() { s_epoch.fetch_add(1, std::memory_order_release); }
+
+ private:
+  static std::atomic<unsigned long long> s_epoch;
+};
+template <typename Type>
+std::atomic<unsigned long long> SingletonTypeEpoch<Type>::s_epoch{1};
+
+/**
+ * @brief Epoch based reclamation of the instances readers may still hold
+ *
+ * Each thread owns a reader slot on its own cache line. Entering a read
+ * section stores @ref SingletonEpoch::current into the slot, leaving it
+ * stores 0, so readers never write to shared cache lines and never wait.
+ *
+ * A writer unpublishes an instance, bumps @ref SingletonEpoch and calls
+ * @ref synchronize, which returns once every slot is either outside a read
+ * section or has entered one after the bump. No reader can reach the
+ * unpublished instance anymore, so it's safe to destruct.
+ */
+class SingletonReclamation {
+ public:
+  /**
+   * @brief Enter a read section, read sections can nest
+   */
+  static void enter() {
+    if (t_depth++ != 0) return;
+    Slot *slot = t_slot != nullptr ? t_slot : acquireSlot();
+    // Ordered before the loads of instance pointers in the section
+    slot->epoch.store(SingletonEpoch::current(), std::memory_order_seq_cst);
+  }
+
+  /**
+   * @brief Leave a read section
+   */
+  static void leave() {
+    assert(t_depth > 0);
+    if (--t_depth == 0) t_slot->epoch.store(0, std::memory_order_release);
+  }
+
+  /**
+   * @brief Wait for the read sections entered before the last bump of
+   * @ref SingletonEpoch
+   *
+   * Must not be called inside a read section, which would wait for itself.
+   */
+  static void synchronize();
+
+ private:
+  struct alignas(SINGLETON_CACHE_LINE_SIZE) Slot {
+    // Epoch the read section started in, 0 outside read sections
+    std::atomic<unsigned long long> epoch{0};
+    std::atomic<bool> owned{false};
+    Slot *next = nullptr;
+  };
+
+  friend class SingletonFork;
+
+  static Slot *acquireSlot();
+
+  // Slots are never freed, the ones of exited threads are reused
+  static std::atomic<Slot *> s_slots;
+  static inline thread_local Slot *t_slot = nullptr;
+  static inline thread_local int t_depth = 0;
+};
+
+/**
+ * @brief Read section pinning an instance until the guard goes out of scope
+ *
+ * The instance is loaded sequentially consistent, against the stores
+ * publishing and unpublishing the instances. So either the guard sees the
+ * new instance, or @ref SingletonReclamation::synchronize sees the guard and
+ * waits for it before destructing the old one.
+ */
+template <typename Type>
+class SingletonReadGuard {
+ public:
+  /**
+   * @brief Hold an instance that is never destructed, without a read section
+   */
+  explicit SingletonReadGuard(Type *pointer)
+      : m_pointer(pointer), m_section(false) {}
+
+  /**
+   * @brief Enter a read section, then load the instance
+   *
+   * @param find Callable returning the `const std::atomic<Type *> *` the
+   * instance is published in, or nullptr if there is none. It's called
+   * inside the section, so what it reads is pinned too.
+   */
+  template <typename Find>
+  explicit SingletonReadGuard(Find &&find) : m_section(true) {
+    SingletonReclamation::enter();
+    const std::atomic<Type *> *published = find();
+    m_pointer = published != nullptr
+                    ? published->load(std::memory_order_seq_cst)
+                    : nullptr;
+  }
+  ~SingletonReadGuard() {
+    if (m_section) SingletonReclamation::leave();
+  }
+  SingletonReadGuard(const SingletonReadGuard &) = delete;
+  SingletonReadGuard &operator=(const SingletonReadGuard &) = delete;
+
+  Type *get() const { return m_pointer; }
+  Type *operator->() const {
+    assert(m_pointer != nullptr);
+    return m_pointer;
+  }
+  Type &operator*() const {
+    assert(m_pointer != nullptr);
+    return *m_pointer;
+  }
+  explicit operator bool() const { return m_pointer != nullptr; }
+
+ private:
+  Type *m_pointer;
+  bool m_section;
+};
+
+/**
+ * @brief Handle counts of a reference counted singleton, split per thread
+ *
+ * Each thread counts its handles in a record on its own cache line, so
+ * acquiring and releasing never write to a line shared with other threads.
+ * The instance is idle when all the records are 0, which is only checked
+ * when destructing it. Records are never freed, the ones of exited threads
+ * are reused.
+ *
+ * @see SingletonDefaultTraits::reference_counted
+ */
+class SingletonReferenceCount {
+ public:
+  struct alignas(SINGLETON_CACHE_LINE_SIZE) Record {
+    std::atomic<long> count{0};
+    // Acquisitions from 0, telling a busy instance from an idle one between
+    // two checks of the reaper
+    std::atomic<unsigned long> acquisitions{0};
+    std::atomic<bool> owned{false};
+    Record *next = nullptr;
+  };
+
+  /**
+   * @brief Take a record for current thread
+   */
+  Record *claim();
+
+  /**
+   * @brief Whether no handle is held
+   */
+  bool idle() const;
+
+  unsigned long acquisitions() const;
+
+ private:
+  std::atomic<Record *> m_records{nullptr};
+};
+
+/**
+ * @brief Background thread destructing the reference counted singletons
+ * parked for longer than their idle delay
+ *
+ * Started by the first instance that needs it, and stopped on exit before
+ * the parked instances are destructed.
+ */
+class SingletonReaper {
+ public:
+  /**
+   * @brief Node of the list of the types watched
+   */
+  struct Entry {
+    bool (*idle)();
+    unsigned long (*acquisitions)();
+    // Destructs the instance if it's still idle
+    bool (*reap)();
+    std::chrono::milliseconds delay;
+    std::atomic<bool> tracked;
+    Entry *next;
+    // Used by the reaper thread only
+    unsigned long seen;
+    std::chrono::steady_clock::time_point idle_since;
+  };
+
+  /**
+   * @brief Watch the type of entry, once
+   */
+  static void track(Entry *entry);
+
+  /**
+   * @brief Stop the thread, done on exit
+   */
+  static void stop();
+
+ private:
+  friend class SingletonFork;
+  struct State;
+
+  static State *state();
+  static void run();
+  static void lock();
+  static void unlock();
+  static void restartInChild();
+
+  // Entries are never removed, like the types they stand for
+  static std::atomic<Entry *> s_entries;
+  static std::atomic<State *> s_state;
+};
+
+class SingletonSnapshotWriter;
+
+/**
+ * @brief Restorer of the instances from their snapshot images, defined in
+ * singleton_snapshot.h
+ */
+template <typename Type>
+struct SingletonSnapshotRestore;
+
+/**
+ * @brief Base singleton class declaring post construction interface
+ *
+ */
+class SingletonBase {
+ public:
+  /**
+   * @brief Post construction interface
+   *
+   * This function will be called from all the constructed classes immediately
+   * after top instance call returns
+   */
+  virtual void postConstruction() {}
+
+  /**
+   * @brief Snapshot interface
+   *
+   * Write the state to restore the instance from on the next start, see
+   * singleton_snapshot.h
+   *
+   * @return false The instance doesn't support snapshots
+   */
+  virtual bool saveSnapshot(SingletonSnapshotWriter &writer) const {
+    (void)writer;
+    return false;
+  }
+};
+
+/**
+ * @brief Helper class for post construction calls
+ *
+ * The construction stack is kept per thread: a construction chain, the
+ * outermost construction and all the ones nested inside it, runs on a single
+ * thread, so chains on different threads, like the ones of
+ * @ref SingletonRegistry::createAllParallel, neither mix their batches nor
+ * share any lock.
+ *
+ * The batch is taken off the stack before running its post constructions, so
+ * a singleton constructed from @ref SingletonBase::postConstruction starts a
+ * chain of its own.
+ *
+ * @todo Maybe this can be achieved by template metaprogramming?
+ */
+class SingletonPostConstructionHelper {
+ public:
+  static void push(SingletonBase *pointer) {
+    s_construct_stack_size++;
+    s_classes_under_construction.push_back(pointer);
+  }
+  static void pop() {
+    assert(s_construct_stack_size > 0);
+    if (!--s_construct_stack_size) flush();
+  }
+
+  /**
+   * @brief Pop a construction that failed, without its post construction
+   *
+   * @param pointer The instance whose constructor threw
+   */
+  static void abandon(SingletonBase *pointer) {
+    assert(s_construct_stack_size > 0);
+    auto &batch = s_classes_under_construction;
+    for (auto itr = batch.end(); itr != batch.begin();) {
+      if (*--itr == pointer) {
+        batch.erase(itr);
+        break;
+      }
+    }
+    if (!--s_construct_stack_size) flush();
+  }
+
+ private:
+  static void flush() {
+    std::vector<SingletonBase *> batch;
+    batch.swap(s_classes_under_construction);
+    for (auto ptr : batch) {
+      struct Abort {
+        SingletonBase *ptr;
+        ~Abort() {
+          if (ptr != nullptr)
+            SINGLETON_HOOK(kPostConstructionAbort, typeid(*ptr), ptr);
+        }
+      } abort{ptr};
+      SINGLETON_HOOK(kPostConstructionBegin, typeid(*ptr), ptr);
+      ptr->postConstruction();
+      SINGLETON_HOOK(kPostConstructionEnd, typeid(*ptr), ptr);
+      abort.ptr = nullptr;
+    }
+  }
+
+  static thread_local std::vector<SingletonBase *>
+      s_classes_under_construction;
+  static thread_local int s_construct_stack_size;
+};
+
+/**
+ * @brief Construction and destruction of instances in their memory, shared
+ * by all the kinds of singletons
+ *
+ * Both report to @ref SingletonHooks. The owner of the memory keeps the
+ * allocation, the publication and its own state.
+ */
+class SingletonLifetime {
+ public:
+  /**
+   * @brief Construct the instance in data through build
+   *
+   * @param data Memory of the instance
+   * @param build Callable constructing the instance in data
+   * @param undo Callable taking data back, like to deallocate it, called
+   * if build throws
+   *
+   * Instances derived from @ref SingletonBase are left on the construction
+   * stack, for the caller to pop once it publishes them. If build throws,
+   * the construction is taken off the stack, leaving it as it was, before
+   * undo is called.
+   */
+  template <typename Type, typename Build, typename Undo>
+  static void construct(Type *data, Build &&build, Undo &&undo) {
+    constexpr bool stacked = std::is_base_of<SingletonBase, Type>::value;
+    struct Rollback {
+      Type *data;
+      Undo &undo;
+      ~Rollback() {
+        if (data == nullptr) return;
+        SINGLETON_HOOK(kConstructAbort, typeid(Type), data);
+        if constexpr (stacked) SingletonPostConstructionHelper::abandon(data);
+        undo(data);
+      }
+    };
+    if constexpr (stacked) SingletonPostConstructionHelper::push(data);
+    Rollback rollback{data, undo};
+    SINGLETON_HOOK(kConstructBegin, typeid(Type), data);
+    build(data);
+    SINGLETON_HOOK(kConstructEnd, typeid(Type), data);
+    rollback.data = nullptr;
+  }
+
+  /**
+   * @brief Destruct the instance at pointer, leaving its memory
+   */
+  template <typename Type>
+  static void destruct(Type *pointer) {
+    SINGLETON_HOOK(kDestructBegin, typeid(Type), pointer);
+    pointer->~Type();
+    SINGLETON_HOOK(kDestructEnd, typeid(Type), pointer);
+  }
+};
+
+#ifdef __cpp_constinit
+#define SINGLETON_CONSTINIT constinit
+#else
+// Constant initialization is still guaranteed, only not checked
+#define SINGLETON_CONSTINIT
+#endif
+
+/**
+ * @brief Whether Type() is a constant expression
+ */
+template <typename Type, typename = void>
+struct SingletonConstexprConstructible : std::false_type {};
+template <typename Type>
+struct SingletonConstexprConstructible<Type,
+                                       std::enable_if_t<(Type(), true)>>
+    : std::true_type {};
+
+/**
+ * @brief Whether the instance of Type is constant-initialized, see
+ * @ref SingletonDefaultTraits::constant_initialized
+ */
+template <typename Type>
+struct SingletonConstantInitialized
+    : std::conjunction<
+          std::bool_constant<SingletonTraits<Type>::constant_initialized &&
+                             SingletonTraits<Type>::snapshot_version == 0 &&
+                             SingletonTraits<Type>::fork_policy ==
+                                 SingletonForkPolicy::kKeep &&
+                             !SingletonTraits<Type>::reference_counted>,
+          std::is_same<decltype(&Type::postConstruction),
+                       void (SingletonBase::*)()>,
+          std::is_trivially_destructible<Type>,
+          SingletonConstexprConstructible<Type>> {};
+
+/**
+ * @brief Storage of the constant-initialized instances
+ */
+template <typename Type>
+struct SingletonConstantStorage {
+  static SINGLETON_CONSTINIT Type instance;
+};
+template <typename Type>
+SINGLETON_CONSTINIT Type SingletonConstantStorage<Type>::instance{};
+
+/**
+ * @brief Type list of the singletons a singleton depends on
+ *
+ * @tparam Types Singleton types
+ */
+template <typename... Types>
+struct SingletonDependencies {};
+
+/**
+ * @brief Singleton class implementing Instance and getInstance static functions
+ *
+ * @tparam Type Type of the class
+ * @tparam Dependencies Singleton types that must be constructed before Type,
+ * honored by @ref SingletonRegistry
+ *
+ * To apply singleton pattern on a class A, just let it inherit Singleton<A>.
+ *
+ * Here's a short example:
+ * ```cpp
+ * #include "singleton.h"
+ *
+ * class A : public Singleton<A> {
+ *   //...
+ * };
+ *
+ * int main() {
+ *   A* a = A::createInstance();
+ *   //a->...
+ *   A::destructInstance();
+ *   return 0;
+ * }
+ * ```
+ */
+template <typename Type, typename... Dependencies>
+class Singleton : public SingletonBase {
+ public:
+  using DependencyList = SingletonDependencies<Dependencies...>;
+
+  /**
+   * @brief Get the instance of Type, or construct it on need
+   *
+   * @tparam ConstructorArguments Argument types for construction
+   * @param args Arguments for construction
+   * @return SingletonPointerWrapper<Type> Pointer wrapper class of type, can
+   * be used as raw pointer
+   *
+   * @deprecated User should separate creation logic from instance obtaining
+   */
+  template <typename... ConstructorArguments>
+  [[deprecated]] static SingletonPointerWrapper<Type, ConstructorArguments...>
+  Instance(ConstructorArguments &&...args) {
+    if constexpr (constantInitialized()) {
+      static_assert(sizeof...(ConstructorArguments) == 0,
+                    "Constant initialized instances are default constructed");
+      return {true, constantInstance()};
+    } else {
+      InstanceSafetyHelper<Type> *helper = InstanceSafetyHelper<Type>::Helper();
+      Type *pointer = helper->instance.load(std::memory_order_acquire);
+      if (pointer != nullptr) return {true, pointer};
+      // Either a recursion reference or a concurrent construction, the wrapper
+      // returned here will assert on use
+      if (helper->building.load(std::memory_order_relaxed) != nullptr)
+        return helper->wrapper();
+      SingletonTransition transition(helper->state,
+                                     SingletonState::kConstructing);
+      if (transition.from() == SingletonState::kUninitialized) {
+        construct(transition, helper, [&](Type *data) {
+          if (!restoreSnapshot(data))
+            new (data) Type(std::forward<ConstructorArguments>(args)...);
+        });
+      }
+      return helper->wrapper();
+    }
+  }
+
+  /**
+   * @brief Create the instance of Type, returning its pointer
+   *
+   * @tparam ConstructorArguments Argument types for construction
+   * @param args Arguments for construction, forwarded to the constructor
+   * @return SingletonPointerWrapper<Type> Pointer wrapper class of type, can
+   * be used as raw pointer
+   *
+   * With @ref SingletonDefaultTraits::snapshot_version set, a valid snapshot
+   * image is restored instead, and args are ignored.
+   */
+  template <typename... ConstructorArguments>
+  static SingletonPointerWrapper<Type, ConstructorArguments...> createInstance(
+      ConstructorArguments &&...args) {
+    if constexpr (constantInitialized()) {
+      static_assert(sizeof...(ConstructorArguments) == 0,
+                    "Constant initialized instances are default constructed");
+      return {true, constantInstance()};
+    } else {
+      InstanceSafetyHelper<Type> *helper = InstanceSafetyHelper<Type>::Helper();
+      assert(helper->instance.load(std::memory_order_relaxed) == nullptr);
+      // Created again from its own constructor, which would wait for itself
+      assert(helper->building.load(std::memory_order_relaxed) == nullptr);
+      SingletonTransition transition(helper->state,
+                                     SingletonState::kConstructing);
+      assert(transition.from() == SingletonState::kUninitialized);
+      construct(transition, helper, [&](Type *data) {
+        if (!restoreSnapshot(data))
+          new (data) Type(std::forward<ConstructorArguments>(args)...);
+      });
+      return helper->wrapper();
+    }
+  }
+
+  /**
+   * @brief Create the instance of Type from the result of a factory
+   *
+   * @tparam Factory Callable type returning Type by value
+   * @param factory Function returning the instance, like
+   * `[&] { return Type(...); }`
+   * @return SingletonPointerWrapper<Type> Pointer wrapper class of type, can
+   * be used as raw pointer
+   *
+   * The returned value is materialized directly in the storage of the
+   * instance, so Type needs neither a copy nor a move constructor, and large
+   * members can be built from sources owned by the caller without any
+   * intermediate copy.
+   */
+  template <typename Factory>
+  static SingletonPointerWrapper<Type, Factory> createInstance(
+      std::in_place_t, Factory &&factory) {
+    static_assert(!constantInitialized(),
+                  "Constant initialized instances are default constructed");
+    InstanceSafetyHelper<Type> *helper = InstanceSafetyHelper<Type>::Helper();
+    assert(helper->instance.load(std::memory_order_relaxed) == nullptr);
+    // Created again from its own constructor, which would wait for itself
+    assert(helper->building.load(std::memory_order_relaxed) == nullptr);
+    SingletonTransition transition(helper->state,
+                                   SingletonState::kConstructing);
+    assert(transition.from() == SingletonState::kUninitialized);
+    construct(transition, helper, [&](Type *data) {
+      if (!restoreSnapshot(data)) new (data) Type(factory());
+    });
+    return helper->wrapper();
+  }
+
+  /**
+   * @brief Require the instance of Type to be destructed before the one of
+   * Other, honored by @ref SingletonRegistry::destructAll
+   *
+   * @tparam Other Another singleton type
+   *
+   * Dependencies declared on the template arguments are already destructed
+   * after their dependents, this is for the orders not implied by them.
+   */
+  template <typename Other>
+  static void setDestructBefore();
+
+  /**
+   * @brief Destruct the instance of Type
+   *
+   * With @ref SingletonDefaultTraits::guarded_access enabled, this waits for
+   * the guards of @ref readInstance, so it must not be called holding one.
+   */
+  static void destructInstance() {
+    if constexpr (constantInitialized()) {
+      // Trivially destructible, and never unpublished
+    } else {
+      InstanceSafetyHelper<Type> *helper = InstanceSafetyHelper<Type>::Helper();
+      // Lasts until deallocation, so no new instance reuses the storage early
+      SingletonTransition transition(helper->state,
+                                     SingletonState::kDestroying);
+      assert(transition.from() == SingletonState::kReady);
+      Type *pointer;
+      if constexpr (SingletonTraits<Type>::guarded_access) {
+        pointer = helper->instance.exchange(nullptr, std::memory_order_seq_cst);
+        bumpEpochs();
+        SingletonReclamation::synchronize();
+      } else {
+        // The instance is still reachable while its destructor runs
+        pointer = helper->instance.load(std::memory_order_relaxed);
+      }
+      assert(pointer != nullptr);
+      SingletonLifetime::destruct(pointer);
+      if constexpr (!SingletonTraits<Type>::guarded_access) {
+        helper->instance.store(nullptr, std::memory_order_release);
+        bumpEpochs();
+      }
+      helper->deallocate(pointer);
+      transition.commit(SingletonState::kUninitialized);
+    }
+  }
+
+  /**
+   * @brief Get the instance of Type, asserting it's constructed
+   *
+   * @return Type* Pointer to the instance of Type
+   *
+   * @note
+   * When this function asserts failed, there are two situations:
+   * 1. You are trying to get the instance before calling @ref
+   * Singleton::createInstance,
+   * 2. You are trying to use the instance of Type during its construction
+   *
+   * @note
+   * For the first scenario, please construct it before using;
+   * For the second one, please refer to @ref PointerWrapper for solution.
+   *
+   * @note
+   * With @ref SingletonDefaultTraits::thread_cached enabled, a warm lookup is
+   * a thread_local load compared against @ref SingletonTypeEpoch::current
+   *
+   * @note
+   * With @ref SingletonForkPolicy::kRebuild, the instance dropped by fork()
+   * is constructed again here
+   */
+  static Type *getInstance() {
+    if constexpr (constantInitialized()) {
+      return constantInstance();
+    } else {
+      Type *pointer;
+      if constexpr (SingletonTraits<Type>::thread_cached) {
+        static thread_local struct {
+          unsigned long long epoch;
+          Type *pointer;
+        } cache;
+        unsigned long long epoch = SingletonTypeEpoch<Type>::current();
+        if (cache.epoch != epoch) {
+          cache.pointer = InstanceSafetyHelper<Type>::Helper()->instance.load(
+              std::memory_order_acquire);
+          cache.epoch = epoch;
+        }
+        pointer = cache.pointer;
+      } else {
+        pointer = InstanceSafetyHelper<Type>::Helper()->instance.load(
+            std::memory_order_acquire);
+      }
+      if constexpr (SingletonTraits<Type>::async_policy ==
+                    SingletonAsyncPolicy::kBlock) {
+        if (pointer == nullptr) pointer = waitForInstance();
+      }
+      if constexpr (SingletonTraits<Type>::fork_policy ==
+                    SingletonForkPolicy::kRebuild) {
+        if (pointer == nullptr) pointer = rebuildInstance();
+      }
+      assert(pointer != nullptr);
+      return pointer;
+    }
+  }
+
+  /**
+   * @brief Get the instance of Type if it's constructed
+   *
+   * @return Type* Pointer to the instance of Type, or nullptr
+   */
+  static Type *tryGetInstance() {
+    if constexpr (constantInitialized()) {
+      return constantInstance();
+    } else {
+      return InstanceSafetyHelper<Type>::Helper()->instance.load(
+          std::memory_order_acquire);
+    }
+  }
+
+  /**
+   * @brief Read section pinning the instance of Type, see @ref readInstance
+   */
+  using ReadGuard = SingletonReadGuard<Type>;
+
+  /**
+   * @brief Get the instance of Type, kept alive until the guard goes out of
+   * scope
+   *
+   * @return ReadGuard Guard holding the instance, or nullptr if it's not
+   * constructed
+   *
+   * Unlike the pointer of @ref getInstance, the instance held stays valid
+   * while @ref replaceInstance publishes a new one. Taking a guard is wait-free
+   * and only writes a slot owned by current thread.
+   *
+   * ```cpp
+   * if (auto config = Config::readInstance()) use(config->routes);
+   * ```
+   */
+  static ReadGuard readInstance() {
+    if constexpr (constantInitialized())
+      return ReadGuard(constantInstance());
+    else
+      return ReadGuard(
+          [] { return &InstanceSafetyHelper<Type>::Helper()->instance; });
+  }
+
+  /**
+   * @brief Counted reference to the instance of Type, see @ref acquire
+   */
+  class Handle {
+   public:
+    Handle() = default;
+    Handle(const Handle &other)
+        : m_pointer(other.m_pointer), m_record(other.m_record) {
+      if (m_record != nullptr)
+        m_record->count.fetch_add(1, std::memory_order_relaxed);
+    }
+    Handle(Handle &&other) noexcept
+        : m_pointer(std::exchange(other.m_pointer, nullptr)),
+          m_record(std::exchange(other.m_record, nullptr)) {}
+    Handle &operator=(Handle other) noexcept {
+      std::swap(m_pointer, other.m_pointer);
+      std::swap(m_record, other.m_record);
+      return *this;
+    }
+    ~Handle() {
+      if (m_record != nullptr) release(m_record);
+    }
+
+    Type *get() const { return m_pointer; }
+    Type *operator->() const {
+      assert(m_pointer != nullptr);
+      return m_pointer;
+    }
+    Type &operator*() const {
+      assert(m_pointer != nullptr);
+      return *m_pointer;
+    }
+    explicit operator bool() const { return m_pointer != nullptr; }
+
+   private:
+    friend class Singleton;
+
+    Handle(Type *pointer, SingletonReferenceCount::Record *record)
+        : m_pointer(pointer), m_record(record) {}
+
+    Type *m_pointer = nullptr;
+    SingletonReferenceCount::Record *m_record = nullptr;
+  };
+
+  /**
+   * @brief Get a handle keeping the instance of Type alive, constructing the
+   * instance on need
+   *
+   * @tparam ConstructorArguments Argument types for construction
+   * @param args Arguments for construction, only used when the instance is
+   * constructed by this call
+   * @return Handle Handle to the instance
+   *
+   * Needs @ref SingletonDefaultTraits::reference_counted. While current
+   * thread holds a handle, acquiring another one only increments a counter of
+   * current thread.
+   *
+   * ```cpp
+   * void onBurst() {
+   *   auto index = SearchIndex::acquire();  // Hundreds of MB
+   *   index->query(...);
+   * }  // Destructed once idle for SingletonTraits::idle_milliseconds
+   * ```
+   */
+  template <typename... ConstructorArguments>
+  static Handle acquire(ConstructorArguments &&...args) {
+    static_assert(SingletonTraits<Type>::reference_counted,
+                  "Set SingletonTraits<Type>::reference_counted first");
+    SingletonReferenceCount::Record *record = referenceRecord();
+    InstanceSafetyHelper<Type> *helper = InstanceSafetyHelper<Type>::Helper();
+    if (record->count.fetch_add(1, std::memory_order_relaxed) == 0) {
+      record->acquisitions.fetch_add(1, std::memory_order_relaxed);
+      // Pairs with the fence of reap, either this sees the instance being
+      // destructed, or reap sees the count
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (helper->state.load() != SingletonState::kReady) {
+        // Gives the count back if the constructor throws
+        struct Rollback {
+          SingletonReferenceCount::Record *record;
+          ~Rollback() {
+            if (record != nullptr)
+              record->count.fetch_sub(1, std::memory_order_relaxed);
+          }
+        } rollback{record};
+        revive(helper, std::forward<ConstructorArguments>(args)...);
+        rollback.record = nullptr;
+      }
+    }
+    return Handle(helper->instance.load(std::memory_order_acquire), record);
+  }
+
+  /**
+   * @brief Construct a new instance of Type and publish it in place of the
+   * current one
+   *
+   * @tparam ConstructorArguments Argument types for construction
+   * @param args Arguments for construction, forwarded to the constructor
+   * @return SingletonPointerWrapper<Type> Pointer wrapper class of the new
+   * instance
+   *
+   * Readers see either the old or the new instance, never nullptr. The old
+   * instance is destructed once the guards of @ref readInstance taken before
+   * the swap are released, so this blocks until then and must not be called
+   * while holding a guard. Pointers from @ref getInstance are not protected.
+   *
+   * Requires @ref SingletonHeapStorage, the other storages hold a single
+   * instance.
+   */
+  template <typename... ConstructorArguments>
+  static SingletonPointerWrapper<Type, ConstructorArguments...>
+  replaceInstance(ConstructorArguments &&...args) {
+    static_assert(std::is_same<typename SingletonTraits<Type>::storage,
+                               SingletonHeapStorage>::value,
+                  "replaceInstance needs both instances alive at once");
+    static_assert(!constantInitialized(),
+                  "Constant initialized instances are never replaced");
+    InstanceSafetyHelper<Type> *helper = InstanceSafetyHelper<Type>::Helper();
+    // Destructs the old instance once the new one is published, even if a
+    // post construction throws
+    struct Retire {
+      InstanceSafetyHelper<Type> *helper;
+      Type *old = nullptr;
+      ~Retire() {
+        // Still published if the constructor threw
+        if (old == nullptr ||
+            helper->instance.load(std::memory_order_relaxed) == old)
+          return;
+        SingletonReclamation::synchronize();
+        SingletonLifetime::destruct(old);
+        helper->deallocate(old);
+      }
+    } retire{helper};
+    SingletonTransition transition(helper->state,
+                                   SingletonState::kConstructing);
+    retire.old = helper->instance.load(std::memory_order_relaxed);
+    construct(transition, helper, [&](Type *data) {
+      new (data) Type(std::forward<ConstructorArguments>(args)...);
+    });
+    return helper->wrapper();
+  }
+
+  /**
+   * @brief Create the instance of Type on @ref SingletonExecutor
+   *
+   * @tparam ConstructorArguments Argument types for construction
+   * @param args Arguments for construction, moved or copied to the executor
+   * @return std::shared_future<Type *> Future of the instance, ready after
+   * post construction and the callbacks of @ref whenReady
+   *
+   * Until the construction finishes, @ref getInstance behaves according to
+   * @ref SingletonDefaultTraits::async_policy. If the constructor throws, the
+   * future holds the exception, the callbacks of @ref whenReady are dropped,
+   * and the threads blocked in @ref getInstance are woken up to find no
+   * instance.
+   */
+  template <typename... ConstructorArguments>
+  static std::shared_future<Type *> createInstanceAsync(
+      ConstructorArguments &&...args) {
+    AsyncConstructionState<Type> *state = AsyncConstructionState<Type>::Get();
+    auto promise = std::make_shared<std::promise<Type *>>();
+    std::shared_future<Type *> future = promise->get_future().share();
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      assert(!state->in_flight && tryGetInstance() == nullptr);
+      state->in_flight = true;
+    }
+    // Shared, so that the task stays copyable with move-only arguments
+    auto arguments =
+        std::make_shared<std::tuple<std::decay_t<ConstructorArguments>...>>(
+            std::forward<ConstructorArguments>(args)...);
+    SingletonExecutor::post([state, promise, arguments] {
+      Type *pointer = nullptr;
+      std::exception_ptr error;
+      try {
+        pointer = std::apply(
+            [](auto &...values) {
+              return createInstance(std::move(values)...);
+            },
+            *arguments);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      std::unique_lock<std::mutex> lock(state->mutex);
+      if (error) state->callbacks.clear();
+      // Callbacks may be added while running the previous ones
+      while (!state->callbacks.empty()) {
+        std::vector<std::function<void(Type *)>> callbacks;
+        callbacks.swap(state->callbacks);
+        lock.unlock();
+        for (auto &callback : callbacks) callback(pointer);
+        lock.lock();
+      }
+      state->in_flight = false;
+      state->condition.notify_all();
+      lock.unlock();
+      if (error)
+        promise->set_exception(error);
+      else
+        promise->set_value(pointer);
+    });
+    return future;
+  }
+
+  /**
+   * @brief Call callback with the instance once it's constructed
+   *
+   * @param callback Function to call, run on the executor after the
+   * asynchronous construction in flight, or immediately if the instance
+   * already exists
+   */
+  static void whenReady(std::function<void(Type *)> callback) {
+    AsyncConstructionState<Type> *state = AsyncConstructionState<Type>::Get();
+    std::unique_lock<std::mutex> lock(state->mutex);
+    if (!state->in_flight) {
+      lock.unlock();
+      Type *pointer = tryGetInstance();
+      assert(pointer != nullptr);
+      callback(pointer);
+      return;
+    }
+    state->callbacks.push_back(std::move(callback));
+  }
+
+  /**
+   * @brief Get the instance of Type during its construction
+   *
+   * @return Type* Pointer to the instance of Type
+   *
+   * @deprecated Use of instance during its construction is always risky, and
+   * will very likely to cause instability / crash of the program, so use at
+   * your own risk
+   */
+  [[deprecated]] static Type *getInstanceDuringBuilding() {
+    Type *pointer = InstanceSafetyHelper<Type>::Helper()->building.load(
+        std::memory_order_relaxed);
+    assert(pointer != nullptr);
+    return pointer;
+  }
+
+ private:
+  /**
+   * @brief Whether the instance is constant-initialized, evaluated once Type
+   * is complete
+   */
+  static constexpr bool constantInitialized() {
+    return SingletonConstantInitialized<Type>::value;
+  }
+  static Type *constantInstance() {
+    return &SingletonConstantStorage<Type>::instance;
+  }
+
+  /**
+   * @brief Wait for the asynchronous construction in flight, if any
+   */
+  static Type *waitForInstance() {
+    AsyncConstructionState<Type> *state = AsyncConstructionState<Type>::Get();
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->condition.wait(lock, [state] { return !state->in_flight; });
+    return tryGetInstance();
+  }
+
+  /**
+   * @brief Fork entry of Type, see @ref SingletonDefaultTraits::fork_policy
+   */
+  static SingletonFork::Entry *forkEntry() {
+    static SingletonFork::Entry entry{&dropInstance, false, {false}, nullptr};
+    return &entry;
+  }
+
+  /**
+   * @brief Tell the readers the instance was published or unpublished
+   */
+  static void bumpEpochs() {
+    SingletonEpoch::bump();
+    SingletonTypeEpoch<Type>::bump();
+  }
+
+  /**
+   * @brief Unpublish the instance in the child after fork(), without
+   * destructing it
+   */
+  static void dropInstance() {
+    InstanceSafetyHelper<Type> *helper = InstanceSafetyHelper<Type>::Helper();
+    // Unless current thread is constructing or destructing it
+    if (helper->state.load() != SingletonState::kReady) return;
+    SingletonTransition transition(helper->state,
+                                   SingletonState::kDestroying);
+    helper->instance.store(nullptr, std::memory_order_release);
+    bumpEpochs();
+    forkEntry()->dropped = true;
+    transition.commit(SingletonState::kUninitialized);
+  }
+
+  /**
+   * @brief Construct the instance dropped by fork() again
+   */
+  static Type *rebuildInstance() {
+    static_assert(std::is_default_constructible<Type>::value,
+                  "Instances rebuilt after fork are default constructed");
+    InstanceSafetyHelper<Type> *helper = InstanceSafetyHelper<Type>::Helper();
+    SingletonTransition transition(helper->state,
+                                   SingletonState::kConstructing);
+    if (transition.from() == SingletonState::kUninitialized &&
+        forkEntry()->dropped) {
+      construct(transition, helper, [](Type *data) {
+        if (!restoreSnapshot(data)) new (data) Type();
+      });
+    }
+    return helper->instance.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Handle counts of Type
+   */
+  static SingletonReferenceCount *references() {
+    static SingletonReferenceCount references;
+    return &references;
+  }
+
+  /**
+   * @brief Record of current thread in @ref references
+   */
+  static SingletonReferenceCount::Record *referenceRecord() {
+    // Gives the record back when the thread exits, handles still held
+    // elsewhere keep counting on it
+    static thread_local struct Owner {
+      SingletonReferenceCount::Record *record = nullptr;
+      ~Owner() {
+        if (record != nullptr)
+          record->owned.store(false, std::memory_order_release);
+      }
+    } owner;
+    if (owner.record == nullptr) owner.record = references()->claim();
+    return owner.record;
+  }
+
+  /**
+   * @brief Construct the instance for @ref acquire, unless another thread
+   * just did
+   */
+  template <typename... ConstructorArguments>
+  static void revive(InstanceSafetyHelper<Type> *helper,
+                     ConstructorArguments &&...args) {
+    SingletonTransition transition(helper->state,
+                                   SingletonState::kConstructing);
+    if (transition.from() == SingletonState::kReady) return;
+    construct(transition, helper, [&](Type *data) {
+      if (!restoreSnapshot(data))
+        new (data) Type(std::forward<ConstructorArguments>(args)...);
+    });
+    if constexpr (SingletonTraits<Type>::idle_milliseconds != 0) {
+      SingletonReaper::track(reaperEntry());
+      // Constructed after the helper, so destructed before it, taking the
+      // parked instance along
+      static struct Parking {
+        ~Parking() {
+          SingletonReaper::stop();
+          reap();
+        }
+      } parking;
+    }
+  }
+
+  /**
+   * @brief Release a handle, destructing the instance if it was the last one
+   * and no idle delay is set
+   */
+  static void release(SingletonReferenceCount::Record *record) {
+    if (record->count.fetch_sub(1, std::memory_order_release) != 1) return;
+    if constexpr (SingletonTraits<Type>::idle_milliseconds == 0) reap();
+  }
+
+  /**
+   * @brief Destruct the instance if no handle is held
+   */
+  static bool reap() {
+    if (!references()->idle()) return false;
+    InstanceSafetyHelper<Type> *helper = InstanceSafetyHelper<Type>::Helper();
+    SingletonTransition transition(helper->state,
+                                   SingletonState::kDestroying);
+    if (transition.from() != SingletonState::kReady) return false;
+    // Pairs with the fence of acquire
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!references()->idle()) return false;
+    Type *pointer = helper->instance.load(std::memory_order_relaxed);
+    SingletonLifetime::destruct(pointer);
+    helper->instance.store(nullptr, std::memory_order_release);
+    bumpEpochs();
+    helper->deallocate(pointer);
+    transition.commit(SingletonState::kUninitialized);
+    return true;
+  }
+
+  static SingletonReaper::Entry *reaperEntry() {
+    static SingletonReaper::Entry entry{
+        [] { return references()->idle(); },
+        [] { return references()->acquisitions(); },
+        &reap,
+        std::chrono::milliseconds(SingletonTraits<Type>::idle_milliseconds),
+        {false},
+        nullptr,
+        0,
+        {}};
+    return &entry;
+  }
+
+  /**
+   * @brief Construct the instance in data from its snapshot image, if enabled
+   * and valid
+   */
+  static bool restoreSnapshot(Type *data) {
+    if constexpr (SingletonTraits<Type>::snapshot_version != 0) {
+      return SingletonSnapshotRestore<Type>::restore(data);
+    } else {
+      (void)data;
+      return false;
+    }
+  }
+
+  /**
+   * @brief Construct the instance through build and publish it, with
+   * transition of helper->state in progress
+   *
+   * The transition is committed to ready once the instance is published, so
+   * a post construction throwing leaves the instance constructed.
+   */
+  template <typename Builder>
+  static void construct(SingletonTransition &transition,
+                        InstanceSafetyHelper<Type> *helper, Builder &&build) {
+    Type *data = helper->allocate();
+    helper->building.store(data, std::memory_order_relaxed);
+    SingletonLifetime::construct(data, build, [helper](Type *data) {
+      helper->building.store(nullptr, std::memory_order_relaxed);
+      helper->deallocate(data);
+    });
+    // Sequentially consistent, see SingletonReadGuard
+    helper->instance.store(data, std::memory_order_seq_cst);
+    helper->building.store(nullptr, std::memory_order_relaxed);
+    bumpEpochs();
+    if constexpr (SingletonTraits<Type>::fork_policy !=
+                  SingletonForkPolicy::kKeep) {
+      SingletonFork::track(forkEntry());
+      forkEntry()->dropped = false;
+    }
+    transition.commit(SingletonState::kReady);
+    SingletonPostConstructionHelper::pop();
+  }
+};
+
+/**
+ * @brief Registry building singletons in the order of their dependencies
+ *
+ * Dependencies are declared on the singleton itself, and the whole graph is
+ * constructed with one call:
+ *
+ * ```cpp
+ * class Config : public Singleton<Config> {};
+ * class Database : public Singleton<Database, Config> {};
+ * class Cache : public Singleton<Cache, Config, Database> {};
+ *
+ * int main() {
+ *   // Registers Cache with its dependencies, then constructs Config,
+ *   // Database and Cache in order
+ *   if (!SingletonRegistry::createAll<Cache>()) return 1;
+ *   // ...
+ * }
+ * ```
+ *
+ * Types are constructed by their default constructor, unless a factory is
+ * given on registration. Types already constructed are skipped.
+ *
+ * Teardown goes the other way round: @ref destructAll destructs dependents
+ * before their dependencies, also following @ref Singleton::setDestructBefore.
+ */
+class SingletonRegistry {
+ public:
+  using Factory = void (*)();
+
+  /**
+   * @brief Register Type and, recursively, its dependencies
+   *
+   * @tparam Type The singleton type
+   * @param factory Function constructing Type, defaults to calling its
+   * createInstance without arguments
+   * @return std::size_t Index of Type in the registry
+   */
+  template <typename Type>
+  static std::size_t registerType(Factory factory = nullptr) {
+    if (factory == nullptr) {
+      if constexpr (std::is_default_constructible_v<Type>)
+        factory = [] { Type::createInstance(); };
+    }
+    bool inserted;
+    std::size_t index =
+        addNode(typeid(Type), factory, [] { Type::destructInstance(); },
+                &isConstructed<Type>, &inserted);
+    if (inserted)
+      setDependencies(index,
+                      registerDependencies(typename Type::DependencyList{}));
+    return index;
+  }
+
+  /**
+   * @brief Construct all the registered singletons in dependency order
+   *
+   * @return true All the singletons are constructed
+   * @return false A dependency cycle or a type without factory is found, a
+   * report is printed to stderr and nothing is constructed
+   */
+  static bool createAll();
+
+  /**
+   * @brief Register Types with their dependencies, and construct all the
+   * registered singletons in dependency order
+   */
+  template <typename... Types>
+  static bool createAll() {
+    (registerType<Types>(), ...);
+    return createAll();
+  }
+
+  /**
+   * @brief Timing of one singleton construction in a parallel startup
+   */
+  struct StartupStep {
+    std::string name;
+    /// Seconds from the start of the startup to the start of construction
+    double start;
+    /// Seconds the construction took, including post construction
+    double duration;
+  };
+
+  /**
+   * @brief Construct all the registered singletons on a pool of threads
+   *
+   * A singleton is constructed as soon as all its dependencies are, so
+   * independent singletons are constructed concurrently. Post construction of
+   * a singleton also runs on its worker, before its dependents are started.
+   *
+   * @param workers Count of worker threads, defaults to the count of hardware
+   * threads
+   * @param critical_path If not nullptr, receives the chain of dependent
+   * constructions that took the longest, from the first to the last
+   * @return true All the singletons are constructed
+   * @return false A dependency cycle or a type without factory is found, a
+   * report is printed to stderr and nothing is constructed
+   *
+   * If a factory throws, no other construction is started, and the first
+   * exception is rethrown once the constructions in progress are done. The
+   * singletons constructed by then are kept.
+   */
+  static bool createAllParallel(
+      std::size_t workers = 0,
+      std::vector<StartupStep> *critical_path = nullptr);
+
+  /**
+   * @brief Print startup steps, like a critical path, as a table
+   */
+  static void printStartupSteps(FILE *file,
+                                const std::vector<StartupStep> &steps);
+
+  /**
+   * @brief Destruct all the constructed registered singletons, dependents
+   * before their dependencies
+   *
+   * @param workers Count of worker threads, independent singletons are
+   * destructed concurrently when more than 1, 0 for the count of hardware
+   * threads
+   * @return true All the singletons are destructed
+   * @return false A cycle is found in destruction orders, a report is printed
+   * to stderr and nothing is destructed
+   *
+   * If a destruction throws, no other one is started, and the first exception
+   * is rethrown once the destructions in progress are done.
+   */
+  static bool destructAll(std::size_t workers = 1);
+
+  /**
+   * @brief Call @ref destructAll on exit
+   *
+   * Should be called after all the singletons are registered: the handler is
+   * run before the destruction of the InstanceSafetyHelper of every type
+   * registered by then.
+   *
+   * @param workers Count of worker threads passed to @ref destructAll
+   */
+  static void destructAllAtExit(std::size_t workers = 1);
+
+  /**
+   * @brief Require First to be destructed before Second
+   *
+   * @see Singleton::setDestructBefore
+   */
+  template <typename First, typename Second>
+  static void addDestructionOrder() {
+    addDestructBefore(registerType<First>(), registerType<Second>());
+  }
+
+  /**
+   * @brief Get the human readable name of a type, for reports
+   */
+  static std::string typeName(const std::type_info &type);
+
+ private:
+  struct Node {
+    const std::type_info *type;
+    Factory factory;
+    Factory destroy;
+    bool (*constructed)();
+    std::vector<std::size_t> dependencies;
+    std::vector<std::size_t> destruct_before;
+  };
+
+  template <typename Type>
+  static bool isConstructed() {
+    return InstanceSafetyHelper<Type>::Helper()->instance.load(
+               std::memory_order_acquire) != nullptr;
+  }
+
+  template <typename... Types>
+  static std::vector<std::size_t> registerDependencies(
+      SingletonDependencies<Types...>) {
+    return {registerType<Types>()...};
+  }
+
+  static std::size_t addNode(const std::type_info &type, Factory factory,
+                             Factory destroy, bool (*constructed)(),
+                             bool *inserted);
+  static void addDestructBefore(std::size_t first, std::size_t second);
+  static void setDependencies(std::size_t index,
+                              std::vector<std::size_t> dependencies);
+  static bool sortNodes(const std::vector<Node> &nodes,
+                        std::vector<std::size_t> *order);
+  static bool checkNodes(std::vector<Node> *nodes,
+                         std::vector<std::size_t> *order);
+
+  friend class SingletonFork;
+
+  static std::mutex s_mutex;
+  static std::vector<Node> s_nodes;
+  static std::size_t s_exit_workers;
+};
+
+template <typename Type, typename... Dependencies>
+template <typename Other>
+void Singleton<Type, Dependencies...>::setDestructBefore() {
+  static_assert(std::is_base_of_v<SingletonBase, Other>,
+                "Other must be a singleton type");
+  SingletonRegistry::addDestructionOrder<Type, Other>();
+}
+
 #endif  // SINGLETON_H
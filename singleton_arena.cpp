@@ -0,0 +1,108 @@
+#include "singleton_arena.h"
+
+#include <algorithm>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+std::mutex SingletonArena::s_mutex;
+unsigned char *SingletonArena::s_base;
+// One huge page on most platforms
+std::size_t SingletonArena::s_capacity = 2 << 20;
+std::size_t SingletonArena::s_used;
+int SingletonArena::s_flags = SingletonArena::kTransparentHugePages;
+bool SingletonArena::s_huge_tlb;
+std::vector<SingletonArena::Entry> SingletonArena::s_entries;
+std::vector<SingletonArena::Entry> SingletonArena::s_overflow;
+
+bool SingletonArena::configure(std::size_t capacity, int flags) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  if (s_base != nullptr) return false;
+  s_capacity = capacity;
+  s_flags = flags;
+  return true;
+}
+
+void SingletonArena::map() {
+#ifdef __linux__
+#ifdef MAP_HUGETLB
+  if (s_flags & kHugeTlb) {
+    void *memory = mmap(nullptr, s_capacity, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (memory != MAP_FAILED) {
+      s_base = static_cast<unsigned char *>(memory);
+      s_huge_tlb = true;
+      return;
+    }
+  }
+#endif
+  void *memory = mmap(nullptr, s_capacity, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory != MAP_FAILED) {
+    s_base = static_cast<unsigned char *>(memory);
+#ifdef MADV_HUGEPAGE
+    if (s_flags & kTransparentHugePages)
+      madvise(memory, s_capacity, MADV_HUGEPAGE);
+#endif
+    return;
+  }
+#endif
+  s_base = static_cast<unsigned char *>(::operator new(
+      s_capacity, std::align_val_t(SINGLETON_CACHE_LINE_SIZE)));
+}
+
+void *SingletonArena::allocate(const std::type_info &type, std::size_t size,
+                               std::size_t alignment) {
+  std::unique_lock<std::mutex> lock(s_mutex);
+  for (const Entry &entry : s_entries)
+    if (*entry.type == type) return s_base + entry.offset;
+  for (const Entry &entry : s_overflow)
+    if (*entry.type == type) return reinterpret_cast<void *>(entry.offset);
+
+  if (s_base == nullptr) map();
+  // Slots start on their own cache lines, so they don't share them
+  alignment = std::max<std::size_t>(alignment, SINGLETON_CACHE_LINE_SIZE);
+  std::size_t offset = (s_used + alignment - 1) / alignment * alignment;
+  if (offset + size > s_capacity) {
+    void *memory = ::operator new(size, std::align_val_t(alignment));
+    // Offset holds the address for the slots outside the arena
+    s_overflow.push_back({&type, reinterpret_cast<std::size_t>(memory), size});
+    // Reported outside the lock, the hook may query the arena
+    lock.unlock();
+    SINGLETON_HOOK(kArenaOverflow, type, memory);
+    return memory;
+  }
+  s_entries.push_back({&type, offset, size});
+  s_used = offset + size;
+  return s_base + offset;
+}
+
+std::size_t SingletonArena::footprint() {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  return s_used;
+}
+
+std::vector<SingletonArena::Entry> SingletonArena::entries() {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  return s_entries;
+}
+
+void SingletonArena::report(FILE *file) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  const char *pages = "normal";
+  if (s_huge_tlb)
+    pages = "huge";
+  else if (s_flags & kTransparentHugePages)
+    pages = "transparent huge";
+  fprintf(file, "[SINGLETON] Arena at %p: %zu of %zu bytes used, %s pages\n",
+          static_cast<void *>(s_base), s_used, s_capacity, pages);
+  fprintf(file, "%10s %10s  %s\n", "offset", "size", "singleton");
+  for (const Entry &entry : s_entries)
+    fprintf(file, "%10zu %10zu  %s\n", entry.offset, entry.size,
+            SingletonRegistry::typeName(*entry.type).c_str());
+  for (const Entry &entry : s_overflow)
+    fprintf(file, "%10s %10zu  %s\n", "heap", entry.size,
+            SingletonRegistry::typeName(*entry.type).c_str());
+}
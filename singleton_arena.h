@@ -0,0 +1,116 @@
+/**
+ * @file singleton_arena.h
+ * @author H1MSK (ksda47832338@outlook.com)
+ * @brief Contiguous arena placing singleton instances side by side
+ * @version 0.5
+ * @date 2022-06-26
+ */
+
+#ifndef SINGLETON_ARENA_H
+#define SINGLETON_ARENA_H
+
+#include <cstddef>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#include "singleton.h"
+
+/**
+ * @brief One contiguous memory region shared by the singletons using
+ * @ref SingletonArenaStorage
+ *
+ * Hot singletons scattered over the heap each take a TLB entry. Placing them
+ * in one region, optionally backed by huge pages, lets them share a few.
+ *
+ * Every type gets a slot on its first construction, which is kept and reused
+ * if it's constructed again. The arena is never released.
+ */
+class SingletonArena {
+ public:
+  /// Back the arena with explicit huge pages, see MAP_HUGETLB
+  static constexpr int kHugeTlb = 1;
+  /// Advise transparent huge pages for the arena, see MADV_HUGEPAGE
+  static constexpr int kTransparentHugePages = 2;
+
+  /**
+   * @brief A slot of the arena
+   */
+  struct Entry {
+    const std::type_info *type;
+    std::size_t offset;
+    std::size_t size;
+  };
+
+  /**
+   * @brief Set up the arena, only effective before the first allocation
+   *
+   * @param capacity Bytes reserved for all the instances, types not fitting
+   * fall back to the heap and are reported to the hook as
+   * SingletonEvent::kArenaOverflow
+   * @param flags Combination of @ref kHugeTlb and @ref kTransparentHugePages,
+   * explicit huge pages fall back to normal pages if unavailable
+   * @return true The arena is configured
+   * @return false The arena is already in use
+   */
+  static bool configure(std::size_t capacity, int flags);
+
+  /**
+   * @brief Get the slot of type, allocating it on first use
+   */
+  static void *allocate(const std::type_info &type, std::size_t size,
+                        std::size_t alignment);
+
+  /**
+   * @brief Get the bytes of the arena in use, including padding
+   */
+  static std::size_t footprint();
+
+  /**
+   * @brief Get all the slots, in the order of their offsets
+   */
+  static std::vector<Entry> entries();
+
+  /**
+   * @brief Print the footprint and the slots of the arena
+   */
+  static void report(FILE *file);
+
+ private:
+  static void map();
+
+  static std::mutex s_mutex;
+  static unsigned char *s_base;
+  static std::size_t s_capacity;
+  static std::size_t s_used;
+  static int s_flags;
+  static bool s_huge_tlb;
+  static std::vector<Entry> s_entries;
+  static std::vector<Entry> s_overflow;
+};
+
+/**
+ * @brief Storage policy placing the instance in @ref SingletonArena
+ *
+ * ```cpp
+ * template <>
+ * struct SingletonTraits<A> : SingletonDefaultTraits {
+ *   using storage = SingletonArenaStorage;
+ * };
+ * ```
+ */
+struct SingletonArenaStorage {
+  template <typename Type>
+  struct Storage {
+    Type *allocate() {
+      return static_cast<Type *>(
+          SingletonArena::allocate(typeid(Type), sizeof(Type), alignof(Type)));
+    }
+    // The slot is kept for the next construction of Type
+    void deallocate(Type *) {}
+  };
+};
+
+#endif  // SINGLETON_ARENA_H
@@ -0,0 +1,209 @@
+#include "singleton_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <new>
+#include <string>
+
+namespace {
+
+thread_local long long t_allocations;
+
+struct Frame {
+  const std::type_info *type;
+  SingletonEvent kind;
+  double wall;
+  double cpu;
+  long long allocations;
+};
+thread_local std::vector<Frame> t_frames;
+
+int threadIndex() {
+  static std::atomic<int> s_next{0};
+  thread_local int index = s_next.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+double wallMicroseconds() {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+double cpuMicroseconds() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  timespec time;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) == 0)
+    return time.tv_sec * 1e6 + time.tv_nsec / 1e3;
+#endif
+  return std::clock() * 1e6 / CLOCKS_PER_SEC;
+}
+
+void writeEscaped(FILE *file, const std::string &text) {
+  for (char c : text) {
+    if (c == '"' || c == '\\') fputc('\\', file);
+    fputc(c, file);
+  }
+}
+
+}  // namespace
+
+#ifdef SINGLETON_PROFILE_ALLOCATIONS
+// Inlined in this file, the deletes are taken for frees of memory from new
+#if defined(__GNUC__) && __GNUC__ >= 11 && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void *operator new(std::size_t size) {
+  SingletonProfiler::countAllocation();
+  if (size == 0) size = 1;
+  for (;;) {
+    if (void *pointer = std::malloc(size)) return pointer;
+    std::new_handler handler = std::get_new_handler();
+    if (handler == nullptr) throw std::bad_alloc();
+    handler();
+  }
+}
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  SingletonProfiler::countAllocation();
+  std::size_t align = static_cast<std::size_t>(alignment);
+  // aligned_alloc takes a multiple of the alignment
+  size = size == 0 ? align : (size + align - 1) / align * align;
+  for (;;) {
+    if (void *pointer = std::aligned_alloc(align, size)) return pointer;
+    std::new_handler handler = std::get_new_handler();
+    if (handler == nullptr) throw std::bad_alloc();
+    handler();
+  }
+}
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept {
+  std::free(pointer);
+}
+void operator delete(void *pointer, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+#if defined(__GNUC__) && __GNUC__ >= 11 && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+SingletonProfiler::SingletonProfiler(SingletonHook *next)
+    : m_next(next), m_origin(wallMicroseconds()) {}
+
+void SingletonProfiler::countAllocation() { ++t_allocations; }
+
+void SingletonProfiler::onEvent(SingletonEvent event,
+                                const std::type_info &type,
+                                const void *instance) {
+  switch (event) {
+    case SingletonEvent::kConstructBegin:
+    case SingletonEvent::kPostConstructionBegin:
+      t_frames.push_back({&type, event, 0, 0, 0});
+      // Measured after the push, which may allocate
+      t_frames.back().wall = wallMicroseconds();
+      t_frames.back().cpu = cpuMicroseconds();
+      t_frames.back().allocations = t_allocations;
+      break;
+    case SingletonEvent::kConstructEnd:
+    case SingletonEvent::kPostConstructionEnd:
+      if (!t_frames.empty()) {
+        Frame frame = t_frames.back();
+        t_frames.pop_back();
+        Span span{frame.type,
+                  frame.kind,
+                  threadIndex(),
+                  static_cast<int>(t_frames.size()),
+                  frame.wall - m_origin,
+                  wallMicroseconds() - frame.wall,
+                  cpuMicroseconds() - frame.cpu,
+                  t_allocations - frame.allocations};
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_spans.push_back(span);
+      }
+      break;
+    case SingletonEvent::kConstructAbort:
+    case SingletonEvent::kPostConstructionAbort:
+      if (!t_frames.empty()) t_frames.pop_back();
+      break;
+    default:
+      break;
+  }
+  if (m_next != nullptr) m_next->onEvent(event, type, instance);
+}
+
+std::vector<SingletonProfiler::Span> SingletonProfiler::spans() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_spans;
+}
+
+void SingletonProfiler::writeChromeTrace(FILE *file) const {
+  std::vector<Span> all = spans();
+  fprintf(file, "{\"traceEvents\":[");
+  for (std::size_t i = 0; i < all.size(); ++i) {
+    const Span &span = all[i];
+    fprintf(file, "%s\n{\"name\":\"", i ? "," : "");
+    writeEscaped(file, SingletonRegistry::typeName(*span.type));
+    fprintf(file,
+            "\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"cpu_us\":%.3f,"
+            "\"allocations\":%lld,\"depth\":%d}}",
+            span.kind == SingletonEvent::kConstructBegin ? "construct"
+                                                         : "postConstruction",
+            span.thread, span.start, span.wall, span.cpu, span.allocations,
+            span.depth);
+  }
+  fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+bool SingletonProfiler::writeChromeTrace(const char *path) const {
+  FILE *file = fopen(path, "w");
+  if (file == nullptr) return false;
+  writeChromeTrace(file);
+  return fclose(file) == 0;
+}
+
+void SingletonProfiler::printSummary(FILE *file) const {
+  struct Total {
+    const std::type_info *type;
+    int count = 0;
+    int depth = 0;
+    double wall = 0;
+    double cpu = 0;
+    long long allocations = 0;
+    double post_construction = 0;
+  };
+  std::vector<Total> totals;
+  std::map<std::string, std::size_t> indices;
+  for (const Span &span : spans()) {
+    auto inserted = indices.emplace(span.type->name(), totals.size());
+    if (inserted.second) totals.push_back({span.type});
+    Total &total = totals[inserted.first->second];
+    if (span.kind == SingletonEvent::kConstructBegin) {
+      total.count++;
+      total.depth = std::max(total.depth, span.depth);
+      total.wall += span.wall;
+      total.cpu += span.cpu;
+      total.allocations += span.allocations;
+    } else {
+      total.post_construction += span.wall;
+    }
+  }
+  std::sort(totals.begin(), totals.end(), [](const Total &a, const Total &b) {
+    return a.wall + a.post_construction > b.wall + b.post_construction;
+  });
+  fprintf(file, "%12s %12s %12s %12s %6s %6s  %s\n", "wall (ms)", "cpu (ms)",
+          "post (ms)", "allocations", "count", "depth", "singleton");
+  for (const Total &total : totals)
+    fprintf(file, "%12.3f %12.3f %12.3f %12lld %6d %6d  %s\n",
+            total.wall / 1e3, total.cpu / 1e3, total.post_construction / 1e3,
+            total.allocations, total.count, total.depth,
+            SingletonRegistry::typeName(*total.type).c_str());
+}
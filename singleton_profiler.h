@@ -0,0 +1,97 @@
+/**
+ * @file singleton_profiler.h
+ * @author H1MSK (ksda47832338@outlook.com)
+ * @brief Profiler of singleton construction and post construction
+ * @version 0.5
+ * @date 2022-06-26
+ */
+
+#ifndef SINGLETON_PROFILER_H
+#define SINGLETON_PROFILER_H
+
+#include <cstdio>
+#include <mutex>
+#include <typeinfo>
+#include <vector>
+
+#include "singleton.h"
+
+/**
+ * @brief Hook measuring where startup time goes
+ *
+ * Every construction and post construction is recorded as a span with its
+ * wall time, thread CPU time, count of allocations and nesting depth. Times
+ * of a span include the singletons constructed inside it. Constructions and
+ * post constructions ended by an exception leave no span.
+ *
+ * Allocations are counted by @ref countAllocation, which the global operator
+ * new, aligned or not, calls when singleton_profiler.cpp is compiled with
+ * SINGLETON_PROFILE_ALLOCATIONS defined. Otherwise they are reported as 0,
+ * unless a custom allocator calls it.
+ *
+ * ```cpp
+ * SingletonProfiler profiler;
+ * SingletonHooks::install(&profiler);
+ * SingletonRegistry::createAll<App>();
+ * SingletonHooks::install(nullptr);
+ * profiler.printSummary(stderr);
+ * profiler.writeChromeTrace("startup.json");
+ * ```
+ */
+class SingletonProfiler : public SingletonHook {
+ public:
+  /**
+   * @brief A measured construction or post construction
+   */
+  struct Span {
+    const std::type_info *type;
+    /// kConstructBegin or kPostConstructionBegin
+    SingletonEvent kind;
+    int thread;
+    int depth;
+    /// Microseconds from the construction of the profiler
+    double start;
+    double wall;
+    double cpu;
+    long long allocations;
+  };
+
+  /**
+   * @param next Hook to forward all the events to, like the one installed
+   * before
+   */
+  explicit SingletonProfiler(SingletonHook *next = nullptr);
+
+  void onEvent(SingletonEvent event, const std::type_info &type,
+               const void *instance) override;
+
+  /**
+   * @brief Get all the finished spans
+   */
+  std::vector<Span> spans() const;
+
+  /**
+   * @brief Write the spans as a Chrome trace event file, which can be opened
+   * in chrome://tracing or Perfetto
+   */
+  void writeChromeTrace(FILE *file) const;
+  bool writeChromeTrace(const char *path) const;
+
+  /**
+   * @brief Print the time spent on each type, the slowest first
+   */
+  void printSummary(FILE *file) const;
+
+  /**
+   * @brief Count an allocation of current thread
+   */
+  static void countAllocation();
+
+ private:
+  SingletonHook *m_next;
+  double m_origin;
+  mutable std::mutex m_mutex;
+  std::vector<Span> m_spans;
+};
+
+#endif  // SINGLETON_PROFILER_H
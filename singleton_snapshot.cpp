@@ -0,0 +1,214 @@
+#include "singleton_snapshot.h"
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'G', 'L', 'T', 'S', 'N', 'A', 'P'};
+constexpr std::uint32_t kFormat = 1;
+// The state starts on its own cache line, aligned for any value in it
+constexpr std::size_t kHeaderSize = 64;
+
+struct Header {
+  char magic[8];
+  std::uint32_t format;
+  std::uint32_t version;
+  std::uint64_t type_hash;
+  std::uint64_t size;
+  std::uint64_t checksum;
+};
+static_assert(sizeof(Header) <= kHeaderSize, "Header overflows its line");
+
+std::uint64_t fnv1a(const void *data, std::size_t size) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  std::uint64_t hash = 14695981039346656037ull;
+  for (std::size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+std::uint64_t typeHash(const std::type_info &type) {
+  return fnv1a(type.name(), std::strlen(type.name()));
+}
+
+struct Mapping {
+  const std::type_info *type;
+  void *address;
+  std::size_t length;
+};
+
+std::mutex s_mutex;
+std::string s_directory;
+std::vector<Mapping> s_mappings;
+thread_local const char *t_rejection = nullptr;
+
+void release(const Mapping &mapping) {
+#ifdef __linux__
+  munmap(mapping.address, mapping.length);
+#else
+  ::operator delete(mapping.address);
+#endif
+}
+
+// Map the whole file read-only, leaving address nullptr on failure
+Mapping map(const std::string &path) {
+  Mapping mapping{nullptr, nullptr, 0};
+#ifdef __linux__
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return mapping;
+  struct stat status;
+  if (fstat(fd, &status) == 0 && status.st_size > 0) {
+    void *address =
+        mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address != MAP_FAILED) {
+      mapping.address = address;
+      mapping.length = status.st_size;
+    }
+  }
+  close(fd);
+#else
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == nullptr) return mapping;
+  if (fseek(file, 0, SEEK_END) == 0) {
+    long size = ftell(file);
+    if (size > 0 && fseek(file, 0, SEEK_SET) == 0) {
+      void *address = ::operator new(size);
+      if (fread(address, 1, size, file) == static_cast<std::size_t>(size)) {
+        mapping.address = address;
+        mapping.length = size;
+      } else {
+        ::operator delete(address);
+      }
+    }
+  }
+  fclose(file);
+#endif
+  return mapping;
+}
+
+}  // namespace
+
+void SingletonSnapshotWriter::append(const void *data, std::size_t size,
+                                     std::size_t alignment) {
+  std::size_t offset =
+      (m_buffer.size() + alignment - 1) / alignment * alignment;
+  m_buffer.resize(offset + size);
+  if (size != 0) std::memcpy(m_buffer.data() + offset, data, size);
+}
+
+const void *SingletonSnapshotView::take(std::size_t size,
+                                        std::size_t alignment) const {
+  std::size_t offset = (m_offset + alignment - 1) / alignment * alignment;
+  if (offset > m_size || size > m_size - offset) return nullptr;
+  m_offset = offset + size;
+  return m_data + offset;
+}
+
+void SingletonSnapshot::setDirectory(std::string directory) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  s_directory = std::move(directory);
+}
+
+std::string SingletonSnapshot::directory() {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  return s_directory;
+}
+
+const char *SingletonSnapshot::rejection() { return t_rejection; }
+
+std::string SingletonSnapshot::path(const std::type_info &type) {
+  // Mangled names are made of letters, digits and underscores
+  return directory() + "/" + type.name() + ".snapshot";
+}
+
+bool SingletonSnapshot::save(const std::type_info &type, unsigned version,
+                             const SingletonBase &instance) {
+  if (directory().empty()) return false;
+  SingletonSnapshotWriter writer;
+  if (!instance.saveSnapshot(writer)) return false;
+  const std::vector<unsigned char> &state = writer.buffer();
+
+  unsigned char header[kHeaderSize] = {};
+  Header fields;
+  std::memcpy(fields.magic, kMagic, sizeof(kMagic));
+  fields.format = kFormat;
+  fields.version = version;
+  fields.type_hash = typeHash(type);
+  fields.size = state.size();
+  fields.checksum = fnv1a(state.data(), state.size());
+  std::memcpy(header, &fields, sizeof(fields));
+
+  std::string target = path(type);
+  std::string temporary = target + ".tmp";
+  FILE *file = fopen(temporary.c_str(), "wb");
+  if (file == nullptr) return false;
+  bool written = fwrite(header, 1, kHeaderSize, file) == kHeaderSize &&
+                 fwrite(state.data(), 1, state.size(), file) == state.size();
+  written = fclose(file) == 0 && written;
+  if (!written || std::rename(temporary.c_str(), target.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool SingletonSnapshot::load(const std::type_info &type, unsigned version,
+                             SingletonSnapshotView *view) {
+  t_rejection = nullptr;
+  if (directory().empty()) return false;
+  Mapping mapping = map(path(type));
+  if (mapping.address == nullptr) return false;
+
+  const unsigned char *image =
+      static_cast<const unsigned char *>(mapping.address);
+  Header fields;
+  const char *problem = nullptr;
+  if (mapping.length < kHeaderSize) {
+    problem = "truncated";
+  } else {
+    std::memcpy(&fields, image, sizeof(fields));
+    if (std::memcmp(fields.magic, kMagic, sizeof(kMagic)) != 0 ||
+        fields.format != kFormat || fields.type_hash != typeHash(type))
+      problem = "not an image of this type";
+    else if (fields.version != version)
+      problem = "of another version";
+    else if (fields.size != mapping.length - kHeaderSize)
+      problem = "truncated";
+    else if (fields.checksum != fnv1a(image + kHeaderSize, fields.size))
+      problem = "corrupted";
+  }
+  if (problem != nullptr) {
+    release(mapping);
+    t_rejection = problem;
+    SINGLETON_HOOK(kSnapshotRejected, type, nullptr);
+    return false;
+  }
+
+  mapping.type = &type;
+  {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    // The instance restored from the previous mapping is destructed by now
+    for (Mapping &previous : s_mappings) {
+      if (*previous.type == type) {
+        release(previous);
+        previous = mapping;
+        mapping.type = nullptr;
+        break;
+      }
+    }
+    if (mapping.type != nullptr) s_mappings.push_back(mapping);
+  }
+  *view = SingletonSnapshotView(image + kHeaderSize, fields.size);
+  return true;
+}
@@ -0,0 +1,195 @@
+/**
+ * @file singleton_snapshot.h
+ * @author H1MSK (ksda47832338@outlook.com)
+ * @brief Warm start of singletons from memory-mapped snapshot images
+ * @version 0.5
+ * @date 2022-06-26
+ */
+
+#ifndef SINGLETON_SNAPSHOT_H
+#define SINGLETON_SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+
+#include "singleton.h"
+
+/**
+ * @brief Buffer collecting the state written by
+ * @ref SingletonBase::saveSnapshot
+ *
+ * Values are aligned in the image as they are in memory, so
+ * @ref SingletonSnapshotView::read hands them back without copying.
+ */
+class SingletonSnapshotWriter {
+ public:
+  /**
+   * @brief Append count values, aligned to their alignment
+   */
+  template <typename Value>
+  void write(const Value *values, std::size_t count = 1) {
+    static_assert(std::is_trivially_copyable<Value>::value,
+                  "Only trivially copyable values can be written");
+    append(values, sizeof(Value) * count, alignof(Value));
+  }
+
+  /**
+   * @brief Append size bytes of data, aligned to alignment
+   */
+  void append(const void *data, std::size_t size, std::size_t alignment = 1);
+
+  const std::vector<unsigned char> &buffer() const { return m_buffer; }
+
+ private:
+  std::vector<unsigned char> m_buffer;
+};
+
+/**
+ * @brief Read-only view of a snapshot image, in the order it was written
+ *
+ * The memory stays mapped until the image of the type is loaded again, after
+ * the instance is destructed, so the instance may keep the pointers returned
+ * by @ref read instead of copying the data.
+ */
+class SingletonSnapshotView {
+ public:
+  SingletonSnapshotView() = default;
+  SingletonSnapshotView(const unsigned char *data, std::size_t size)
+      : m_data(data), m_size(size) {}
+
+  /**
+   * @brief Take the next count values written by
+   * @ref SingletonSnapshotWriter::write
+   *
+   * @return const Value* Values inside the image, or nullptr past its end
+   */
+  template <typename Value>
+  const Value *read(std::size_t count = 1) const {
+    return static_cast<const Value *>(
+        take(sizeof(Value) * count, alignof(Value)));
+  }
+
+  const unsigned char *data() const { return m_data; }
+  std::size_t size() const { return m_size; }
+
+ private:
+  const void *take(std::size_t size, std::size_t alignment) const;
+
+  const unsigned char *m_data = nullptr;
+  std::size_t m_size = 0;
+  mutable std::size_t m_offset = 0;
+};
+
+/**
+ * @brief Saving and loading of the snapshot images
+ *
+ * A type opts in by setting @ref SingletonDefaultTraits::snapshot_version,
+ * overriding @ref SingletonBase::saveSnapshot, and adding a constructor from
+ * @ref SingletonSnapshotView reading back what it wrote:
+ *
+ * ```cpp
+ * class Routes : public Singleton<Routes> {
+ *  public:
+ *   explicit Routes(const Config &config);  // Seconds to compute
+ *   explicit Routes(const SingletonSnapshotView &view)
+ *       : m_count(*view.read<std::size_t>()),
+ *         m_table(view.read<Route>(m_count)) {}
+ *   bool saveSnapshot(SingletonSnapshotWriter &writer) const override {
+ *     writer.write(&m_count);
+ *     writer.write(m_table, m_count);
+ *     return true;
+ *   }
+ *   // ...
+ * };
+ *
+ * template <>
+ * struct SingletonTraits<Routes> : SingletonDefaultTraits {
+ *   static constexpr unsigned snapshot_version = 1;
+ * };
+ *
+ * int main() {
+ *   SingletonSnapshot::setDirectory("/var/cache/app");
+ *   Routes::createInstance(config);  // Restored if the image is valid
+ *   SingletonSnapshot::save<Routes>();
+ *   // ...
+ * }
+ * ```
+ *
+ * Each image has a header with the version of the type and a checksum of the
+ * state. A missing, stale or corrupted image is ignored, and the instance is
+ * built from the arguments of createInstance as usual. Images are written to
+ * a temporary file first and renamed, so a crash never leaves a partial one.
+ */
+class SingletonSnapshot {
+ public:
+  /**
+   * @brief Set the directory of the images, snapshots are disabled while it's
+   * empty, which is the default
+   */
+  static void setDirectory(std::string directory);
+  static std::string directory();
+
+  /**
+   * @brief Write the image of the instance of Type
+   *
+   * @return true The image is written
+   * @return false Snapshots are disabled, the instance is not constructed,
+   * doesn't support snapshots, or the image can't be written
+   */
+  template <typename Type>
+  static bool save() {
+    static_assert(SingletonTraits<Type>::snapshot_version != 0,
+                  "Set SingletonTraits<Type>::snapshot_version first");
+    Type *pointer = Type::tryGetInstance();
+    if (pointer == nullptr) return false;
+    return save(typeid(Type), SingletonTraits<Type>::snapshot_version,
+                *pointer);
+  }
+  static bool save(const std::type_info &type, unsigned version,
+                   const SingletonBase &instance);
+
+  /**
+   * @brief Map the image of type
+   *
+   * @param view Set to the state in the image if it's valid. The mapping of
+   * the previous load of type is released.
+   * @return false No valid image of version is found. An invalid one is
+   * reported to the hook as SingletonEvent::kSnapshotRejected.
+   */
+  static bool load(const std::type_info &type, unsigned version,
+                   SingletonSnapshotView *view);
+
+  /**
+   * @brief Get why the last image loaded on the calling thread was rejected
+   *
+   * @return const char* The problem, such as "corrupted", or nullptr if the
+   * image was valid or missing
+   */
+  static const char *rejection();
+
+  /**
+   * @brief Get the path of the image of type
+   */
+  static std::string path(const std::type_info &type);
+};
+
+template <typename Type>
+struct SingletonSnapshotRestore {
+  static bool restore(Type *data) {
+    static_assert(
+        std::is_constructible<Type, const SingletonSnapshotView &>::value,
+        "Snapshots need a constructor from const SingletonSnapshotView &");
+    SingletonSnapshotView view;
+    unsigned version = SingletonTraits<Type>::snapshot_version;
+    if (!SingletonSnapshot::load(typeid(Type), version, &view)) return false;
+    new (data) Type(view);
+    return true;
+  }
+};
+
+#endif  // SINGLETON_SNAPSHOT_H
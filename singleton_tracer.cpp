@@ -0,0 +1,81 @@
+#include "singleton_tracer.h"
+
+#include <chrono>
+
+namespace {
+
+const char *eventName(SingletonEvent event) {
+  switch (event) {
+    case SingletonEvent::kConstructBegin:
+      return "construct begin";
+    case SingletonEvent::kConstructEnd:
+      return "construct end";
+    case SingletonEvent::kPostConstructionBegin:
+      return "post construction begin";
+    case SingletonEvent::kPostConstructionEnd:
+      return "post construction end";
+    case SingletonEvent::kDestructBegin:
+      return "destruct begin";
+    case SingletonEvent::kDestructEnd:
+      return "destruct end";
+    case SingletonEvent::kConstructAbort:
+      return "construct abort";
+    case SingletonEvent::kPostConstructionAbort:
+      return "post construction abort";
+    case SingletonEvent::kArenaOverflow:
+      return "arena overflow";
+    case SingletonEvent::kSnapshotRejected:
+      return "snapshot rejected";
+  }
+  return "unknown";
+}
+
+}  // namespace
+
+SingletonRingTracer::SingletonRingTracer(std::size_t capacity) {
+  std::size_t size = 1;
+  while (size < capacity) size <<= 1;
+  m_mask = size - 1;
+  m_records.reset(new Record[size]);
+}
+
+void SingletonRingTracer::onEvent(SingletonEvent event,
+                                  const std::type_info &type,
+                                  const void *instance) {
+  std::uint64_t index = m_head.fetch_add(1, std::memory_order_relaxed);
+  Record &record = m_records[index & m_mask];
+  record.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  record.nanoseconds.store(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count(),
+      std::memory_order_relaxed);
+  record.event.store(static_cast<int>(event), std::memory_order_relaxed);
+  record.type.store(&type, std::memory_order_relaxed);
+  record.instance.store(instance, std::memory_order_relaxed);
+  record.sequence.store(index + 1, std::memory_order_release);
+}
+
+void SingletonRingTracer::dump(FILE *file) const {
+  std::uint64_t head = m_head.load(std::memory_order_acquire);
+  std::uint64_t size = m_mask + 1;
+  std::uint64_t begin = head > size ? head - size : 0;
+  for (std::uint64_t index = begin; index < head; ++index) {
+    const Record &record = m_records[index & m_mask];
+    if (record.sequence.load(std::memory_order_acquire) != index + 1) continue;
+    std::int64_t nanoseconds =
+        record.nanoseconds.load(std::memory_order_relaxed);
+    int event = record.event.load(std::memory_order_relaxed);
+    const std::type_info *type = record.type.load(std::memory_order_relaxed);
+    const void *instance = record.instance.load(std::memory_order_relaxed);
+    // Skip the records overwritten while being read
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (record.sequence.load(std::memory_order_relaxed) != index + 1) continue;
+    fprintf(file, "[SINGLETON] %lld.%06lld %-24s %s at %p\n",
+            static_cast<long long>(nanoseconds / 1000000000),
+            static_cast<long long>(nanoseconds % 1000000000 / 1000),
+            eventName(static_cast<SingletonEvent>(event)),
+            SingletonRegistry::typeName(*type).c_str(), instance);
+  }
+}
@@ -0,0 +1,74 @@
+/**
+ * @file singleton_tracer.h
+ * @author H1MSK (ksda47832338@outlook.com)
+ * @brief Lock-free ring buffer recording singleton lifetime events
+ * @version 0.5
+ * @date 2022-06-26
+ */
+
+#ifndef SINGLETON_TRACER_H
+#define SINGLETON_TRACER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <typeinfo>
+
+#include "singleton.h"
+
+/**
+ * @brief Hook recording the latest singleton events into a ring buffer
+ *
+ * Recording is lock-free and makes no system call, so it can run inside the
+ * construction critical section. The oldest events are overwritten once the
+ * buffer is full. The buffer is printed on demand by @ref dump.
+ *
+ * ```cpp
+ * SingletonRingTracer tracer;
+ * SingletonHooks::install(&tracer);
+ * // ...
+ * tracer.dump(stderr);
+ * SingletonHooks::install(nullptr);
+ * ```
+ */
+class SingletonRingTracer : public SingletonHook {
+ public:
+  /**
+   * @param capacity Count of events kept, rounded up to a power of 2
+   */
+  explicit SingletonRingTracer(std::size_t capacity = 1024);
+
+  void onEvent(SingletonEvent event, const std::type_info &type,
+               const void *instance) override;
+
+  /**
+   * @brief Print the recorded events, from the oldest to the latest
+   */
+  void dump(FILE *file) const;
+
+  /**
+   * @brief Get the count of events recorded since construction, including
+   * the overwritten ones
+   */
+  std::uint64_t recorded() const {
+    return m_head.load(std::memory_order_acquire);
+  }
+
+ private:
+  struct Record {
+    // Index of the event plus one once fully written, 0 while writing
+    std::atomic<std::uint64_t> sequence{0};
+    std::atomic<std::int64_t> nanoseconds{0};
+    std::atomic<int> event{0};
+    std::atomic<const std::type_info *> type{nullptr};
+    std::atomic<const void *> instance{nullptr};
+  };
+
+  std::size_t m_mask;
+  std::unique_ptr<Record[]> m_records;
+  std::atomic<std::uint64_t> m_head{0};
+};
+
+#endif  // SINGLETON_TRACER_H
@@ -0,0 +1,78 @@
+#include "../multiton.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Threads racing on the same keys construct each once, and readers holding
+// guards never see an evicted instance destructed
+
+constexpr int kKeys = 5000;
+
+std::atomic<int> g_constructions[kKeys];
+
+class Shard : public Multiton<int, Shard> {
+ public:
+  explicit Shard(int key) : key(key) { g_constructions[key].fetch_add(1); }
+  ~Shard() { alive = false; }
+
+  int key;
+  bool alive = true;
+};
+
+class Tenant : public Multiton<std::string, Tenant> {
+ public:
+  explicit Tenant(std::string name) : name(std::move(name)) {}
+
+  std::string name;
+};
+
+int main() {
+  // Constructed once per key, while the table grows under the lookups
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([t] {
+      for (int i = 0; i < kKeys; ++i) {
+        int key = (i * 7 + t) % kKeys;
+        assert(Shard::getOrCreateInstance(key, key)->key == key);
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  threads.clear();
+  for (int i = 0; i < kKeys; ++i) assert(g_constructions[i] == 1);
+
+  // Evicted and constructed again under the readers
+  std::vector<int> hot = {1, 2, 3, 4};
+  std::atomic<bool> done{false};
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&] {
+      while (!done.load(std::memory_order_relaxed)) {
+        for (int key : hot) {
+          if (auto shard = Shard::readInstance(key)) assert(shard->alive);
+        }
+      }
+    });
+  }
+  for (int round = 0; round < 500; ++round) {
+    assert(Shard::evict(hot) == hot.size());
+    Shard::prefetch(hot, 0);
+  }
+  done = true;
+  for (auto &thread : threads) thread.join();
+  assert(g_constructions[0] == 1 + 500 * static_cast<int>(hot.size()));
+
+  assert(Tenant::tryGetInstance("acme") == nullptr);
+  Tenant::createInstance("acme", "acme");
+  assert(Tenant::getInstance("acme")->name == "acme");
+  assert(Tenant::destructInstance("acme"));
+  assert(!Tenant::destructInstance("acme"));
+  assert(!Tenant::destructInstance("unknown"));
+
+  assert(Shard::destructAll() == kKeys);
+  puts("OK");
+  return 0;
+}
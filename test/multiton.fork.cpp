@@ -0,0 +1,47 @@
+#include "../multiton.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+// Forking while another thread adds keys never leaves the table locked in
+// the child
+
+class Entry : public Multiton<int, Entry> {
+ public:
+  explicit Entry(int key) : key(key) {}
+
+  int key;
+};
+
+int main() {
+  std::atomic<bool> stop{false};
+  std::thread inserter([&] {
+    for (int key = 0; !stop.load(); ++key) Entry::getOrCreateInstance(key, key);
+  });
+  for (int round = 0; round < 50; ++round) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      // Takes the table lock, and forks again from the child
+      int key = -1 - round;
+      if (Entry::getOrCreateInstance(key, key)->key != key) _exit(1);
+      pid_t grandchild = fork();
+      if (grandchild == 0) _exit(0);
+      int status;
+      waitpid(grandchild, &status, 0);
+      _exit(WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+  stop = true;
+  inserter.join();
+  Entry::destructAll();
+
+  puts("OK");
+  return 0;
+}
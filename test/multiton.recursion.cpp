@@ -0,0 +1,46 @@
+#include "../multiton.h"
+
+#include <cassert>
+#include <csignal>
+#include <cstdio>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// A constructor may ask for other keys, but asking for its own key would wait
+// for itself forever, so it asserts
+
+class Chain : public Multiton<int, Chain> {
+ public:
+  explicit Chain(int key) : key(key) {
+    if (key > 0) next = Chain::getOrCreateInstance(key - 1, key - 1);
+  }
+
+  int key;
+  Chain *next = nullptr;
+};
+
+class Recursive : public Multiton<int, Recursive> {
+ public:
+  explicit Recursive(int key) { Recursive::getOrCreateInstance(key, key); }
+};
+
+int main() {
+  Chain *chain = Chain::getOrCreateInstance(3, 3);
+  for (int key = 3; key > 0; --key, chain = chain->next)
+    assert(chain->key == key && chain->next == Chain::getInstance(key - 1));
+  std::size_t destructed = Chain::destructAll();
+  assert(destructed == 4);
+
+#ifndef NDEBUG
+  pid_t pid = fork();
+  if (pid == 0) {
+    Recursive::getOrCreateInstance(0, 0);
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+#endif
+  printf("OK\n");
+  return 0;
+}
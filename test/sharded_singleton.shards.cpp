@@ -0,0 +1,94 @@
+#include "../sharded_singleton.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Shards are counted together, picked by each selector, and a failed
+// construction leaves nothing behind
+
+class Counter : public ShardedSingleton<Counter, 8, ThreadShardSelector> {
+ public:
+  std::atomic<long> value{0};
+};
+
+class CpuCounter : public ShardedSingleton<CpuCounter, 4> {
+ public:
+  std::atomic<long> value{0};
+};
+
+class NodeCounter
+    : public ShardedSingleton<NodeCounter, 2, NumaNodeShardSelector> {
+ public:
+  std::atomic<long> value{0};
+};
+
+std::atomic<int> g_alive{0};
+int g_post_constructions = 0;
+
+class Faulty : public ShardedSingleton<Faulty, 4, ThreadShardSelector> {
+ public:
+  explicit Faulty(int fail_at) {
+    if (s_built++ == fail_at) throw std::runtime_error("fail");
+    g_alive++;
+  }
+  ~Faulty() { g_alive--; }
+  void postConstruction() override { ++g_post_constructions; }
+
+  static int s_built;
+};
+int Faulty::s_built = 0;
+
+template <typename Type>
+long total() {
+  long sum = 0;
+  Type::forEachShard([&](Type *shard) { sum += shard->value; });
+  return sum;
+}
+
+int main() {
+  Counter::createInstance();
+  CpuCounter::createInstance();
+  NodeCounter::createInstance();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < 8; ++t) {
+    workers.emplace_back([t] {
+      ThreadShardSelector::bind(t);
+      assert(Counter::getInstance() == Counter::getShard(t));
+      for (int i = 0; i < 1000; ++i) {
+        Counter::getInstance()->value++;
+        CpuCounter::getInstance()->value++;
+        NodeCounter::getInstance()->value++;
+      }
+    });
+  }
+  for (auto &worker : workers) worker.join();
+  assert(total<Counter>() == 8000 && Counter::getShard(3)->value == 1000);
+  assert(total<CpuCounter>() == 8000 && total<NodeCounter>() == 8000);
+  for (std::size_t i = 0; i < Counter::shardCount(); ++i) {
+    auto address = reinterpret_cast<std::uintptr_t>(Counter::getShard(i));
+    assert(address % SINGLETON_CACHE_LINE_SIZE == 0);
+  }
+  NodeCounter::destructInstance();
+  CpuCounter::destructInstance();
+  Counter::destructInstance();
+
+  try {
+    Faulty::createInstance(2);
+    assert(false);
+  } catch (const std::runtime_error &) {
+  }
+  assert(g_alive == 0 && g_post_constructions == 0);
+  Faulty::s_built = 0;
+  Faulty::createInstance(-1);
+  assert(g_alive == 4 && g_post_constructions == 4);
+  Faulty::destructInstance();
+  assert(g_alive == 0);
+
+  puts("OK");
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include "../shared_memory_singleton.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Processes racing to create the same instance construct it once, and all
+// see the same memory
+
+class Squares : public SharedMemorySingleton<Squares> {
+ public:
+  Squares() {
+    for (int i = 0; i < 4096; ++i) table[i] = i * i;
+  }
+
+  std::atomic<int> attached{0};
+  int table[4096];
+};
+
+constexpr int kWorkers = 6;
+
+int worker(const char *name) {
+  Squares *squares = Squares::createInstance(name);
+  if (squares == nullptr) return 2;
+  if (squares->table[4095] != 4095 * 4095) return 2;
+  // Stay attached until every worker is, so none of them constructs again
+  squares->attached.fetch_add(1);
+  while (squares->attached.load() < kWorkers) usleep(100);
+  int created = Squares::createdHere() ? 1 : 0;
+  Squares::destructInstance();
+  return created;
+}
+
+int main() {
+  std::string name = "/singleton_test_" + std::to_string(getpid());
+  SharedMemoryRegion::unlink(name.c_str());
+
+  for (int i = 0; i < kWorkers; ++i) {
+    if (fork() == 0) _exit(worker(name.c_str()));
+  }
+  int creators = 0;
+  for (int i = 0; i < kWorkers; ++i) {
+    int status;
+    wait(&status);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) < 2);
+    creators += WEXITSTATUS(status);
+  }
+  assert(creators == 1);
+  // Removed by the last worker
+  assert(!SharedMemoryRegion::unlink(name.c_str()));
+
+  puts("OK");
+  return 0;
+}
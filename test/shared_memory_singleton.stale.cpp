@@ -0,0 +1,57 @@
+#include "../shared_memory_singleton.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// A region whose creator died before sizing or claiming it fails the later
+// processes in bounded time, until it's removed
+
+class Table : public SharedMemorySingleton<Table> {
+ public:
+  int values[16] = {1};
+};
+
+// The control block takes the first cache line
+constexpr std::size_t kLength = 64 + sizeof(Table);
+
+double failAfter(const char *name) {
+  auto start = std::chrono::steady_clock::now();
+  Table *table = Table::createInstance(name);
+  assert(table == nullptr);
+  (void)table;
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+int main() {
+  std::string name = "/singleton_test_" + std::to_string(getpid());
+  SharedMemoryRegion::unlink(name.c_str());
+
+  // Created, never sized
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  assert(fd >= 0);
+  double unsized = failAfter(name.c_str());
+  assert(unsized >= 2 && unsized < 10);
+
+  // Sized, never claimed
+  assert(ftruncate(fd, kLength) == 0);
+  close(fd);
+  double unclaimed = failAfter(name.c_str());
+  assert(unclaimed >= 2 && unclaimed < 10);
+
+  assert(SharedMemoryRegion::unlink(name.c_str()));
+  Table *table = Table::createInstance(name.c_str());
+  assert(table != nullptr && table->values[0] == 1);
+  assert(Table::createdHere());
+  Table::destructInstance();
+  assert(!SharedMemoryRegion::unlink(name.c_str()));
+
+  puts("OK");
+  return 0;
+}
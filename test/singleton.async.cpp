@@ -0,0 +1,69 @@
+#include "../singleton.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+
+// Threads blocking on an asynchronous construction, callbacks waiting for
+// it, and a construction that throws
+
+class Slow : public Singleton<Slow> {
+ public:
+  Slow() { std::this_thread::sleep_for(std::chrono::milliseconds(50)); }
+
+  int value = 1;
+};
+
+class Faulty : public Singleton<Faulty> {
+ public:
+  explicit Faulty(bool fail) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    if (fail) throw std::runtime_error("fail");
+  }
+};
+
+template <>
+struct SingletonTraits<Slow> : SingletonDefaultTraits {
+  static constexpr int async_policy = SingletonAsyncPolicy::kBlock;
+};
+
+template <>
+struct SingletonTraits<Faulty> : SingletonDefaultTraits {
+  static constexpr int async_policy = SingletonAsyncPolicy::kBlock;
+};
+
+int main() {
+  auto future = Slow::createInstanceAsync();
+  std::atomic<int> callbacks{0};
+  Slow::whenReady([&](Slow *slow) {
+    assert(slow->value == 1);
+    callbacks++;
+  });
+  // Blocks until the construction finishes
+  std::thread reader([] { assert(Slow::getInstance()->value == 1); });
+  assert(Slow::getInstance()->value == 1);
+  reader.join();
+  assert(future.get() == Slow::getInstance() && callbacks == 1);
+  // Runs right away once constructed
+  Slow::whenReady([&](Slow *) { callbacks++; });
+  assert(callbacks == 2);
+  Slow::destructInstance();
+
+  auto failed = Faulty::createInstanceAsync(true);
+  Faulty::whenReady([](Faulty *) { assert(false); });
+  try {
+    failed.get();
+    assert(false);
+  } catch (const std::runtime_error &) {
+  }
+  assert(Faulty::tryGetInstance() == nullptr);
+  // Not left in flight
+  assert(Faulty::createInstanceAsync(false).get() != nullptr);
+  Faulty::destructInstance();
+
+  puts("OK");
+  return 0;
+}
@@ -0,0 +1,258 @@
+#include "../collectable.h"
+#include "../singleton.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// Benchmarks of the hot paths of Singleton and Collector, each against the
+// same work done through a plain global and a function-local static
+//
+// Usage: singleton.benchmark [scale], scale multiplies the iteration counts
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double nanoseconds(Clock::time_point begin, Clock::time_point end) {
+  return std::chrono::duration<double, std::nano>(end - begin).count();
+}
+
+// Keeps the compiler from hoisting the lookups out of the loops, without
+// emitting any instruction
+void barrier() { std::atomic_signal_fence(std::memory_order_seq_cst); }
+
+struct Payload {
+  long value = 1;
+};
+
+Payload g_payload;
+
+Payload *globalPayload() { return &g_payload; }
+
+Payload *staticPayload() {
+  static Payload payload;
+  return &payload;
+}
+
+class Counter : public Singleton<Counter> {
+ public:
+  long value = 1;
+};
+
+class CachedCounter : public Singleton<CachedCounter> {
+ public:
+  long value = 1;
+};
+
+class InPlaceCounter : public Singleton<InPlaceCounter> {
+ public:
+  long value = 1;
+};
+
+class ConstantCounter : public Singleton<ConstantCounter> {
+ public:
+  long value = 1;
+};
+
+}  // namespace
+
+template <>
+struct SingletonTraits<ConstantCounter> : SingletonDefaultTraits {
+  static constexpr bool constant_initialized = true;
+};
+
+template <>
+struct SingletonTraits<CachedCounter> : SingletonDefaultTraits {
+  static constexpr bool thread_cached = true;
+};
+
+template <>
+struct SingletonTraits<InPlaceCounter> : SingletonDefaultTraits {
+  using storage = SingletonInPlaceStorage;
+};
+
+namespace {
+
+/**
+ * @brief Average nanoseconds per lookup of each thread, all threads running
+ * at once
+ */
+template <typename Getter>
+double lookups(unsigned threads, long iterations, Getter get) {
+  std::vector<std::thread> workers;
+  std::vector<double> times(threads);
+  std::atomic<unsigned> ready{0};
+  for (unsigned t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      ready.fetch_add(1);
+      while (ready.load() != threads) std::this_thread::yield();
+      long sum = 0;
+      auto begin = Clock::now();
+      for (long i = 0; i < iterations; ++i) {
+        sum += get()->value;
+        barrier();
+      }
+      times[t] = nanoseconds(begin, Clock::now()) / iterations;
+      if (sum != iterations) printf("Wrong sum %ld\n", sum);
+    });
+  }
+  for (auto &worker : workers) worker.join();
+  double total = 0;
+  for (double time : times) total += time;
+  return total / threads;
+}
+
+void benchmarkLookups(long scale) {
+  const long iterations = 2000000 * scale;
+  printf("getInstance, ns per lookup per thread, %u hardware threads\n",
+         std::thread::hardware_concurrency());
+  printf("%8s %10s %10s %10s %10s %10s\n", "threads", "global", "static",
+         "singleton", "cached", "constant");
+  Counter::createInstance();
+  CachedCounter::createInstance();
+  for (unsigned threads = 1; threads <= 128; threads *= 2) {
+    long each = iterations / threads + 1;
+    printf("%8u %10.3f %10.3f %10.3f %10.3f %10.3f\n", threads,
+           lookups(threads, each, globalPayload),
+           lookups(threads, each, staticPayload),
+           lookups(threads, each, Counter::getInstance),
+           lookups(threads, each, CachedCounter::getInstance),
+           lookups(threads, each, ConstantCounter::getInstance));
+  }
+  CachedCounter::destructInstance();
+  Counter::destructInstance();
+}
+
+template <typename Body>
+double perIteration(long iterations, Body body) {
+  auto begin = Clock::now();
+  for (long i = 0; i < iterations; ++i) {
+    body();
+    barrier();
+  }
+  return nanoseconds(begin, Clock::now()) / iterations;
+}
+
+void benchmarkChurn(long scale) {
+  const long iterations = 1000000 * scale;
+  alignas(Payload) static unsigned char storage[sizeof(Payload)];
+  printf("\ncreateInstance / destructInstance, ns per pair\n");
+  printf("%10s %10s %10s %10s\n", "global", "heap", "singleton", "in place");
+  double global = perIteration(iterations, [] {
+    Payload *payload = new (storage) Payload;
+    payload->~Payload();
+  });
+  double heap = perIteration(iterations, [] { delete new Payload; });
+  double singleton = perIteration(iterations, [] {
+    Counter::createInstance();
+    Counter::destructInstance();
+  });
+  double in_place = perIteration(iterations, [] {
+    InPlaceCounter::createInstance();
+    InPlaceCounter::destructInstance();
+  });
+  printf("%10.3f %10.3f %10.3f %10.3f\n", global, heap, singleton, in_place);
+}
+
+class Item : public AutoCollectable<Item> {
+ public:
+  long value = 1;
+};
+
+struct PlainItem {
+  long value = 1;
+};
+
+std::unordered_set<PlainItem *> g_items;
+
+std::unordered_set<PlainItem *> &staticItems() {
+  static std::unordered_set<PlainItem *> items;
+  return items;
+}
+
+template <typename Container>
+double plainRegistrations(long rounds, std::size_t count, Container &items) {
+  std::unique_ptr<PlainItem[]> storage(new PlainItem[count]);
+  items.reserve(count);
+  auto begin = Clock::now();
+  for (long round = 0; round < rounds; ++round) {
+    for (std::size_t i = 0; i < count; ++i) items.insert(&storage[i]);
+    for (std::size_t i = 0; i < count; ++i) items.erase(&storage[i]);
+  }
+  return nanoseconds(begin, Clock::now()) / (rounds * count);
+}
+
+double collectableRegistrations(long rounds, std::size_t count) {
+  std::allocator<Item> allocator;
+  Item *storage = allocator.allocate(count);
+  auto begin = Clock::now();
+  for (long round = 0; round < rounds; ++round) {
+    for (std::size_t i = 0; i < count; ++i) new (&storage[i]) Item;
+    for (std::size_t i = 0; i < count; ++i) storage[i].~Item();
+  }
+  double time = nanoseconds(begin, Clock::now()) / (rounds * count);
+  allocator.deallocate(storage, count);
+  return time;
+}
+
+template <typename Container>
+double iteration(long rounds, const Container &items) {
+  long sum = 0;
+  auto begin = Clock::now();
+  for (long round = 0; round < rounds; ++round) {
+    for (auto *item : items) sum += item->value;
+    barrier();
+  }
+  double time = nanoseconds(begin, Clock::now());
+  if (sum != rounds * static_cast<long>(items.size()))
+    printf("Wrong sum %ld\n", sum);
+  // Millions of items per second
+  return rounds * items.size() / time * 1e3;
+}
+
+void benchmarkCollector(long scale) {
+  const std::size_t count = 4096;
+  const long rounds = 200 * scale;
+  printf("\nAutoCollectable, ns per registration and deregistration\n");
+  printf("%10s %10s %10s\n", "global", "static", "collector");
+  double global = plainRegistrations(rounds, count, g_items);
+  double local = plainRegistrations(rounds, count, staticItems());
+  double collector = collectableRegistrations(rounds, count);
+  printf("%10.3f %10.3f %10.3f\n", global, local, collector);
+
+  printf("\nCollector iteration, millions of items per second\n");
+  printf("%10s %10s %10s %10s\n", "items", "global", "static", "collector");
+  for (std::size_t items = 64; items <= (1 << 20); items *= 16) {
+    std::unique_ptr<PlainItem[]> plain(new PlainItem[items]);
+    std::unique_ptr<Item[]> collectables(new Item[items]);
+    for (std::size_t i = 0; i < items; ++i) {
+      g_items.insert(&plain[i]);
+      staticItems().insert(&plain[i]);
+    }
+    long passes = rounds * count / items + 1;
+    printf("%10zu %10.1f %10.1f %10.1f\n", items, iteration(passes, g_items),
+           iteration(passes, staticItems()),
+           iteration(passes, Collector<Item>::getInstance()->container()));
+    g_items.clear();
+    staticItems().clear();
+  }
+  Collector<Item>::destructInstance();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  long scale = argc > 1 ? std::atol(argv[1]) : 1;
+  if (scale < 1) scale = 1;
+  benchmarkLookups(scale);
+  benchmarkChurn(scale);
+  benchmarkCollector(scale);
+  return 0;
+}
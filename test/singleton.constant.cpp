@@ -0,0 +1,70 @@
+#include "../singleton.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <string>
+
+// Only the opted in, stateless or constexpr constructible types are
+// constant-initialized
+
+class Flags : public Singleton<Flags> {
+ public:
+  std::atomic<int> value{7};
+};
+
+class Name : public Singleton<Name> {
+ public:
+  std::string value = "name";
+};
+
+class Hooked : public Singleton<Hooked> {
+ public:
+  void postConstruction() override {}
+};
+
+class Plain : public Singleton<Plain> {
+ public:
+  int value = 1;
+};
+
+#define CONSTANT_INITIALIZED(Name)                        \
+  template <>                                             \
+  struct SingletonTraits<Name> : SingletonDefaultTraits { \
+    static constexpr bool constant_initialized = true;    \
+  }
+CONSTANT_INITIALIZED(Flags);
+CONSTANT_INITIALIZED(Name);
+CONSTANT_INITIALIZED(Hooked);
+
+static_assert(SingletonConstantInitialized<Flags>::value, "");
+static_assert(!SingletonConstantInitialized<Name>::value, "");
+static_assert(!SingletonConstantInitialized<Hooked>::value, "");
+static_assert(!SingletonConstantInitialized<Plain>::value, "");
+
+// Usable from dynamic initializers of other translation units
+static int g_initial = Flags::getInstance()->value.load();
+
+int main() {
+  assert(g_initial == 7);
+  assert(Flags::tryGetInstance() == Flags::getInstance());
+  Flags *flags = Flags::createInstance();
+  assert(flags == Flags::getInstance());
+  flags->value = 8;
+  Flags::destructInstance();
+  assert(Flags::getInstance()->value == 8);
+
+  assert(Name::tryGetInstance() == nullptr);
+  Name::createInstance();
+  assert(Name::getInstance()->value == "name");
+  Name::destructInstance();
+
+  // Not opted in, so reset by a rebuild
+  Plain::createInstance()->value = 2;
+  Plain::destructInstance();
+  assert(Plain::createInstance()->value == 1);
+  Plain::destructInstance();
+
+  puts("OK");
+  return 0;
+}
@@ -0,0 +1,86 @@
+#include "../singleton.h"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Contention microbenchmark of Singleton::getInstance against the plain
+// double-checked locking it used before the pointer was made atomic, and
+// against the thread_local cached lookup
+
+class Counter : public Singleton<Counter> {
+ public:
+  long value = 1;
+};
+
+class CachedCounter : public Singleton<CachedCounter> {
+ public:
+  long value = 1;
+};
+
+template <>
+struct SingletonTraits<CachedCounter> : SingletonDefaultTraits {
+  static constexpr bool thread_cached = true;
+};
+
+class LegacyCounter {
+ public:
+  long value = 1;
+
+  static LegacyCounter *getInstance() {
+    static LegacyHelper helper;
+    if (helper.raw_pointer == nullptr) {
+      helper.mutex.lock();
+      if (helper.raw_pointer == nullptr) helper.raw_pointer = new LegacyCounter;
+      helper.mutex.unlock();
+    }
+    return helper.raw_pointer;
+  }
+
+ private:
+  struct LegacyHelper {
+    LegacyCounter *raw_pointer = nullptr;
+    std::mutex mutex;
+    ~LegacyHelper() { delete raw_pointer; }
+  };
+};
+
+template <typename Getter>
+double run(unsigned threads, long iterations, Getter get) {
+  std::vector<std::thread> workers;
+  std::vector<long> sums(threads);
+  auto begin = std::chrono::steady_clock::now();
+  for (unsigned t = 0; t < threads; ++t)
+    workers.emplace_back([&, t] {
+      long sum = 0;
+      for (long i = 0; i < iterations; ++i) sum += get()->value;
+      sums[t] = sum;
+    });
+  for (auto &worker : workers) worker.join();
+  auto end = std::chrono::steady_clock::now();
+  for (long sum : sums)
+    if (sum != iterations) printf("Wrong sum %ld\n", sum);
+  return std::chrono::duration<double, std::nano>(end - begin).count() /
+         iterations;
+}
+
+int main() {
+  constexpr long kIterations = 20000000;
+  Counter::createInstance();
+  CachedCounter::createInstance();
+  unsigned max_threads = std::thread::hardware_concurrency();
+  if (max_threads == 0) max_threads = 4;
+  printf("%8s %16s %16s %16s\n", "threads", "legacy ns/op", "atomic ns/op",
+         "cached ns/op");
+  for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+    double legacy = run(threads, kIterations, LegacyCounter::getInstance);
+    double atomic = run(threads, kIterations, Counter::getInstance);
+    double cached = run(threads, kIterations, CachedCounter::getInstance);
+    printf("%8u %16.3f %16.3f %16.3f\n", threads, legacy, atomic, cached);
+  }
+  CachedCounter::destructInstance();
+  Counter::destructInstance();
+  return 0;
+}
@@ -0,0 +1,33 @@
+#include "../singleton.h"
+
+#include <cassert>
+#include <cstdio>
+
+// A dependency cycle is reported, and nothing is constructed. Registrations
+// are never removed, so the cycle is checked in a program of its own.
+
+bool g_constructed = false;
+
+class Config : public Singleton<Config> {
+ public:
+  Config() { g_constructed = true; }
+};
+
+class Loop;
+class Recursion : public Singleton<Recursion, Loop> {};
+class Loop : public Singleton<Loop, Config, Recursion> {};
+
+int main() {
+  // Reports the cycle Recursion -> Loop -> Recursion
+  bool success = SingletonRegistry::createAll<Recursion>();
+  assert(!success);
+  success = SingletonRegistry::createAllParallel(2);
+  assert(!success);
+  assert(!g_constructed);
+  assert(Config::tryGetInstance() == nullptr);
+  assert(Loop::tryGetInstance() == nullptr);
+  assert(Recursion::tryGetInstance() == nullptr);
+
+  puts("OK");
+  return 0;
+}
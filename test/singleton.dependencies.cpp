@@ -0,0 +1,120 @@
+#include "../singleton.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Dependencies are constructed before, and destructed after, their
+// dependents, as are the extra destruction orders
+
+std::mutex g_mutex;
+std::vector<std::string> g_events;
+
+void record(const char *event) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  g_events.push_back(event);
+}
+
+// Position of event in the events recorded since the last check
+std::size_t position(const char *event) {
+  auto found = std::find(g_events.begin(), g_events.end(), event);
+  assert(found != g_events.end());
+  return found - g_events.begin();
+}
+
+void work() { std::this_thread::sleep_for(std::chrono::milliseconds(20)); }
+
+class Logger : public Singleton<Logger> {
+ public:
+  Logger() { record("+Logger"); }
+  ~Logger() { record("-Logger"); }
+};
+
+class Config : public Singleton<Config> {
+ public:
+  Config() {
+    work();
+    record("+Config");
+  }
+  ~Config() { record("-Config"); }
+};
+
+class Database : public Singleton<Database, Config> {
+ public:
+  Database() {
+    work();
+    record("+Database");
+    Config::getInstance();
+  }
+  ~Database() { record("-Database"); }
+};
+
+class Cache : public Singleton<Cache, Config, Database> {
+ public:
+  Cache() {
+    work();
+    record("+Cache");
+    Database::getInstance();
+  }
+  ~Cache() {
+    work();
+    record("-Cache");
+  }
+};
+
+void checkConstruction() {
+  assert(g_events.size() == 4);
+  assert(position("+Config") < position("+Database"));
+  assert(position("+Database") < position("+Cache"));
+  g_events.clear();
+}
+
+void checkDestruction() {
+  assert(g_events.size() == 4);
+  assert(position("-Cache") < position("-Database"));
+  assert(position("-Database") < position("-Config"));
+  // Logger is not a dependency, but Cache logs on destruction
+  assert(position("-Cache") < position("-Logger"));
+  g_events.clear();
+}
+
+int main() {
+  bool success = SingletonRegistry::createAll<Logger, Cache>();
+  assert(success);
+  checkConstruction();
+
+  Cache::setDestructBefore<Logger>();
+  success = SingletonRegistry::destructAll(2);
+  assert(success);
+  checkDestruction();
+
+  std::vector<SingletonRegistry::StartupStep> critical_path;
+  success = SingletonRegistry::createAllParallel(4, &critical_path);
+  assert(success);
+  checkConstruction();
+  SingletonRegistry::printStartupSteps(stdout, critical_path);
+  // Config, Database and Cache each take 20 ms, one after the other
+  assert(critical_path.size() == 3);
+  const char *chain[] = {"Config", "Database", "Cache"};
+  for (std::size_t i = 0; i < critical_path.size(); ++i) {
+    const SingletonRegistry::StartupStep &step = critical_path[i];
+    assert(step.name.find(chain[i]) != std::string::npos);
+    assert(step.duration >= 0.02);
+    if (i > 0) {
+      const SingletonRegistry::StartupStep &previous = critical_path[i - 1];
+      assert(step.start >= previous.start + previous.duration);
+    }
+  }
+
+  success = SingletonRegistry::destructAll();
+  assert(success);
+  checkDestruction();
+
+  puts("OK");
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include "../singleton.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+// The child of a fork never inherits a construction or a read section of
+// another thread, and keeps or drops the instances by their fork policy
+
+std::atomic<bool> g_started{false};
+
+class Slow : public Singleton<Slow> {
+ public:
+  Slow() {
+    g_started = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    done = true;
+  }
+
+  bool done = false;
+};
+
+class Config : public Singleton<Config> {
+ public:
+  int version = 1;
+};
+
+class Kept : public Singleton<Kept> {
+ public:
+  int value = 1;
+};
+
+int g_rebuilds = 0;
+
+class Rebuilt : public Singleton<Rebuilt> {
+ public:
+  Rebuilt() { ++g_rebuilds; }
+};
+
+class Dropped : public Singleton<Dropped> {
+ public:
+  int value = 1;
+};
+
+template <>
+struct SingletonTraits<Rebuilt> : SingletonDefaultTraits {
+  static constexpr int fork_policy = SingletonForkPolicy::kRebuild;
+};
+
+template <>
+struct SingletonTraits<Dropped> : SingletonDefaultTraits {
+  static constexpr int fork_policy = SingletonForkPolicy::kDrop;
+};
+
+void child() {
+  // The construction in progress on the other thread was waited for
+  Slow *slow = Slow::tryGetInstance();
+  assert(slow != nullptr && slow->done);
+  Slow::destructInstance();
+
+  // The guard held by the reader thread is gone with it
+  Config::replaceInstance();
+
+  assert(Kept::getInstance()->value == 1);
+  assert(Dropped::tryGetInstance() == nullptr);
+  Dropped::createInstance();
+  assert(Rebuilt::tryGetInstance() == nullptr);
+  Rebuilt::getInstance();
+  assert(g_rebuilds == 2);
+}
+
+int main() {
+  Config::createInstance();
+  Kept::createInstance();
+  Rebuilt::createInstance();
+  Dropped::createInstance();
+
+  std::atomic<bool> reading{false}, forked{false};
+  std::thread reader([&] {
+    auto config = Config::readInstance();
+    reading = true;
+    while (!forked) std::this_thread::yield();
+  });
+  std::thread builder([] { Slow::createInstance(); });
+  while (!g_started || !reading) std::this_thread::yield();
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    child();
+    _exit(0);
+  }
+  forked = true;
+  int status;
+  waitpid(pid, &status, 0);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  builder.join();
+  reader.join();
+  assert(Dropped::tryGetInstance() != nullptr && g_rebuilds == 1);
+  Slow::destructInstance();
+  Dropped::destructInstance();
+  Rebuilt::destructInstance();
+  Kept::destructInstance();
+  Config::destructInstance();
+
+  puts("OK");
+  return 0;
+}
@@ -0,0 +1,54 @@
+#include "../singleton.h"
+
+#include <cassert>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Counts the copies of a large argument on its way to the instance
+
+struct Payload {
+  static int copies;
+  std::vector<int> data;
+  explicit Payload(std::size_t size) : data(size) {}
+  Payload(const Payload &other) : data(other.data) { ++copies; }
+  Payload(Payload &&) = default;
+};
+int Payload::copies = 0;
+
+class Table : public Singleton<Table> {
+ public:
+  Table(Payload payload, std::unique_ptr<std::string> name)
+      : payload(std::move(payload)), name(std::move(name)) {}
+  // Neither copyable nor movable, only buildable in place
+  Table(const Table &) = delete;
+
+  Payload payload;
+  std::unique_ptr<std::string> name;
+};
+
+int main() {
+  Table::createInstance(Payload(1 << 20),
+                        std::make_unique<std::string>("forwarded"));
+  assert(Payload::copies == 0);
+  assert(*Table::getInstance()->name == "forwarded");
+  Table::destructInstance();
+
+  Payload source(1 << 20);
+  Table::createInstance(std::in_place, [&] {
+    return Table(std::move(source), std::make_unique<std::string>("factory"));
+  });
+  assert(Payload::copies == 0);
+  assert(*Table::getInstance()->name == "factory");
+  Table::destructInstance();
+
+  auto future = Table::createInstanceAsync(
+      Payload(16), std::make_unique<std::string>("async"));
+  assert(*future.get()->name == "async");
+  assert(Payload::copies == 0);
+  Table::destructInstance();
+
+  puts("OK");
+  return 0;
+}
@@ -0,0 +1,55 @@
+#include "../singleton.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Readers holding guards while the instance is destructed and rebuilt never
+// see a destructed instance
+
+class Session : public Singleton<Session> {
+ public:
+  Session() : alive(true) {}
+  ~Session() { alive = false; }
+
+  bool alive;
+};
+
+template <>
+struct SingletonTraits<Session> : SingletonDefaultTraits {
+  static constexpr bool guarded_access = true;
+};
+
+int main() {
+  Session::createInstance();
+
+  std::atomic<bool> done{false};
+  std::atomic<long> hits{0}, misses{0};
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&] {
+      while (!done.load(std::memory_order_relaxed)) {
+        if (auto session = Session::readInstance()) {
+          assert(session->alive);
+          hits.fetch_add(1, std::memory_order_relaxed);
+        } else {
+          misses.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    });
+  }
+
+  for (int i = 0; i < 2000; ++i) {
+    Session::destructInstance();
+    Session::createInstance();
+  }
+  done.store(true, std::memory_order_relaxed);
+  for (auto &reader : readers) reader.join();
+  Session::destructInstance();
+  assert(Session::readInstance().get() == nullptr);
+
+  printf("OK %ld hits, %ld misses\n", hits.load(), misses.load());
+  return 0;
+}
@@ -0,0 +1,63 @@
+#include "../singleton.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+
+// A factory throwing on any worker stops the parallel startup, which joins
+// its workers and rethrows the exception to the caller
+
+bool g_fail = true;
+
+template <int Index>
+class Independent : public Singleton<Independent<Index>> {
+ public:
+  Independent() { std::this_thread::sleep_for(std::chrono::milliseconds(2)); }
+};
+
+class Faulty : public Singleton<Faulty> {
+ public:
+  Faulty() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if (g_fail) throw std::runtime_error("faulty");
+  }
+};
+
+class Dependent : public Singleton<Dependent, Faulty> {};
+
+int main() {
+  SingletonRegistry::createAll<Independent<0>, Independent<1>,
+                               Independent<2>, Independent<3>>();
+  SingletonRegistry::registerType<Dependent>();
+  SingletonRegistry::registerType<Independent<4>>();
+  SingletonRegistry::destructAll();
+
+  // The throwing construction lands on a different thread from round to
+  // round, the calling one included
+  for (int round = 0; round < 50; ++round) {
+    bool thrown = false;
+    try {
+      SingletonRegistry::createAllParallel(4);
+    } catch (const std::runtime_error &) {
+      thrown = true;
+    }
+    assert(thrown);
+    assert(Faulty::tryGetInstance() == nullptr);
+    assert(Dependent::tryGetInstance() == nullptr);
+    bool success = SingletonRegistry::destructAll(4);
+    assert(success);
+  }
+
+  g_fail = false;
+  bool success = SingletonRegistry::createAllParallel(4);
+  assert(success);
+  assert(Dependent::tryGetInstance() != nullptr);
+  assert(Independent<4>::tryGetInstance() != nullptr);
+  success = SingletonRegistry::destructAll(4);
+  assert(success);
+
+  puts("OK");
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include "../singleton.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Reference counted instances are destructed once idle, and constructed
+// again by the next acquire, never while a handle is held
+
+std::atomic<int> g_constructions{0}, g_destructions{0};
+
+class Index : public Singleton<Index> {
+ public:
+  Index() { g_constructions.fetch_add(1); }
+  ~Index() {
+    alive = false;
+    g_destructions.fetch_add(1);
+  }
+
+  bool alive = true;
+};
+
+class Buffer : public Singleton<Buffer> {
+ public:
+  ~Buffer() { alive = false; }
+
+  bool alive = true;
+};
+
+template <>
+struct SingletonTraits<Index> : SingletonDefaultTraits {
+  static constexpr bool reference_counted = true;
+  static constexpr unsigned idle_milliseconds = 20;
+};
+
+template <>
+struct SingletonTraits<Buffer> : SingletonDefaultTraits {
+  static constexpr bool reference_counted = true;
+  static constexpr unsigned idle_milliseconds = 0;
+};
+
+template <typename Type>
+void burst(int threads, int iterations) {
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([iterations] {
+      for (int i = 0; i < iterations; ++i) {
+        auto handle = Type::acquire();
+        assert(handle->alive);
+        auto copy = handle;
+        assert(copy.get() == handle.get());
+      }
+    });
+  }
+  for (auto &worker : workers) worker.join();
+}
+
+int main() {
+  // Never destructed while a handle is held
+  {
+    auto held = Index::acquire();
+    burst<Index>(8, 20000);
+    burst<Index>(8, 20000);
+    assert(g_constructions == 1 && g_destructions == 0);
+  }
+
+  // Parked for the idle time after the last release, then destructed
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point released = Clock::now();
+  while (Index::tryGetInstance() != nullptr) {
+    assert(Clock::now() - released < std::chrono::seconds(10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  assert(Clock::now() - released >= std::chrono::milliseconds(20));
+  assert(g_destructions == 1);
+  {
+    auto index = Index::acquire();
+    assert(g_constructions == 2);
+  }
+
+  // Destructed on each last release, racing with the next acquire
+  burst<Buffer>(8, 20000);
+  assert(Buffer::tryGetInstance() == nullptr);
+  {
+    auto buffer = Buffer::acquire();
+    auto moved = std::move(buffer);
+    assert(!buffer && moved->alive);
+  }
+  assert(Buffer::tryGetInstance() == nullptr);
+
+  // The parked Index is destructed on exit
+  puts("OK");
+  return 0;
+}
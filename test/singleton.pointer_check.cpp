@@ -0,0 +1,72 @@
+#include "../singleton.h"
+
+#include <cassert>
+#include <csignal>
+#include <cstdio>
+#include <type_traits>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Each check policy of PointerWrapper on a wrapper of an instance under
+// construction
+
+struct Value {
+  int value = 1;
+};
+
+// The policy of a singleton is chosen by its traits
+
+class Plain : public Singleton<Plain> {};
+
+class Counted : public Singleton<Counted> {
+ public:
+  int value = 1;
+};
+
+template <>
+struct SingletonTraits<Counted> : SingletonDefaultTraits {
+  using pointer_check = PointerWrapperCounting;
+};
+
+static_assert(
+    std::is_same<decltype(Plain::createInstance()),
+                 PointerWrapper<Plain, SINGLETON_POINTER_CHECK>>::value,
+    "");
+static_assert(
+    std::is_same<decltype(Counted::createInstance()),
+                 PointerWrapper<Counted, PointerWrapperCounting>>::value,
+    "");
+
+int main() {
+  Value value;
+
+  PointerWrapper<Value, PointerWrapperUnchecked> unchecked{false, &value};
+  assert(unchecked->value == 1);
+
+  PointerWrapper<Value, PointerWrapperCounting> counted{false, &value};
+  assert(counted->value == 1);
+  Value *pointer = counted;
+  assert(pointer == &value && PointerWrapperCounting::failures() == 2);
+  PointerWrapper<Value, PointerWrapperCounting> constructed{true, &value};
+  assert(constructed->value == 1 && PointerWrapperCounting::failures() == 2);
+
+  auto counted_instance = Counted::createInstance();
+  assert(counted_instance->value == 1);
+  assert(PointerWrapperCounting::failures() == 2);
+  Counted::destructInstance();
+
+  // Aborts even with NDEBUG
+  PointerWrapper<Value, PointerWrapperAlwaysCheck> checked{true, &value};
+  assert(checked->value == 1);
+  pid_t pid = fork();
+  if (pid == 0) {
+    PointerWrapper<Value, PointerWrapperAlwaysCheck> failing{false, &value};
+    _exit(failing->value);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+
+  puts("OK");
+  return 0;
+}
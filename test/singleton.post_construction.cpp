@@ -0,0 +1,86 @@
+#include "../singleton.h"
+
+#include <cassert>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+
+// Two construction chains, built concurrently on their own threads, each
+// checking its post constructions run on its own thread after the chain
+
+template <int Chain>
+class Leaf : public Singleton<Leaf<Chain>> {
+ public:
+  std::thread::id builder = std::this_thread::get_id();
+  bool post_constructed = false;
+  void postConstruction() override {
+    assert(builder == std::this_thread::get_id());
+    post_constructed = true;
+  }
+};
+
+template <int Chain>
+class Root : public Singleton<Root<Chain>> {
+ public:
+  Root() {
+    for (int i = 0; i < 1000; ++i) std::this_thread::yield();
+    Leaf<Chain>::createInstance();
+  }
+  void postConstruction() override {
+    assert(Leaf<Chain>::getInstance()->builder == std::this_thread::get_id());
+  }
+};
+
+class Late : public Singleton<Late> {};
+
+// Stateless, but really constructed again after each destruction
+static_assert(!SingletonConstantInitialized<Late>::value, "");
+
+class Starter : public Singleton<Starter> {
+ public:
+  // Constructing from post construction starts a new chain
+  void postConstruction() override { Late::createInstance(); }
+};
+
+class Broken : public Singleton<Broken> {
+ public:
+  Broken() {
+    Late::destructInstance();
+    Late::createInstance();
+    throw std::runtime_error("broken");
+  }
+};
+
+int main() {
+  for (int round = 0; round < 100; ++round) {
+    std::thread first([] { Root<0>::createInstance(); });
+    std::thread second([] { Root<1>::createInstance(); });
+    first.join();
+    second.join();
+    assert(Leaf<0>::getInstance()->post_constructed);
+    assert(Leaf<1>::getInstance()->post_constructed);
+    Root<0>::destructInstance();
+    Leaf<0>::destructInstance();
+    Root<1>::destructInstance();
+    Leaf<1>::destructInstance();
+  }
+
+  Starter::createInstance();
+  assert(Late::tryGetInstance() != nullptr);
+
+  // The singletons constructed before the failure keep their post
+  // construction, and the stack is usable afterwards
+  try {
+    Broken::createInstance();
+    assert(false);
+  } catch (const std::runtime_error &) {
+  }
+  assert(Broken::tryGetInstance() == nullptr);
+  Starter::destructInstance();
+  Late::destructInstance();
+  Starter::createInstance();
+  Starter::destructInstance();
+  Late::destructInstance();
+  puts("OK");
+  return 0;
+}
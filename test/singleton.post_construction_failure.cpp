@@ -0,0 +1,83 @@
+#include "../multiton.h"
+#include "../sharded_singleton.h"
+
+#include <cassert>
+#include <cstdio>
+#include <stdexcept>
+
+// A post construction throwing leaves the instance constructed and
+// published, so it's destructed, replaced or created again as usual
+
+bool g_fail = false;
+int g_alive = 0;
+
+void postConstruct() {
+  if (g_fail) throw std::runtime_error("post construction");
+}
+
+template <typename Type>
+bool throws(Type &&action) {
+  try {
+    action();
+  } catch (const std::runtime_error &) {
+    return true;
+  }
+  return false;
+}
+
+class Plain : public Singleton<Plain> {
+ public:
+  Plain() { g_alive++; }
+  ~Plain() { g_alive--; }
+  void postConstruction() override { postConstruct(); }
+};
+
+class Keyed : public Multiton<int, Keyed> {
+ public:
+  explicit Keyed(int) { g_alive++; }
+  ~Keyed() { g_alive--; }
+  void postConstruction() override { postConstruct(); }
+};
+
+class Sharded : public ShardedSingleton<Sharded, 4, ThreadShardSelector> {
+ public:
+  Sharded() { g_alive++; }
+  ~Sharded() { g_alive--; }
+  void postConstruction() override { postConstruct(); }
+};
+
+int main() {
+  for (int round = 0; round < 2; ++round) {
+    g_fail = round == 0;
+    bool failed = throws([] { Plain::createInstance(); });
+    assert(failed == g_fail);
+    assert(Plain::tryGetInstance() != nullptr && g_alive == 1);
+    // The old instance is destructed even if the new one throws
+    failed = throws([] { Plain::replaceInstance(); });
+    assert(failed == g_fail);
+    assert(g_alive == 1);
+    Plain::destructInstance();
+    assert(g_alive == 0);
+
+    failed = throws([] { Keyed::createInstance(1, 1); });
+    assert(failed == g_fail);
+    failed = throws([] { Keyed::getOrCreateInstance(2, 2); });
+    assert(failed == g_fail);
+    assert(Keyed::tryGetInstance(1) != nullptr);
+    assert(Keyed::tryGetInstance(2) != nullptr && g_alive == 2);
+    bool destructed = Keyed::destructInstance(1);
+    assert(destructed);
+    destructed = Keyed::destructInstance(2);
+    assert(destructed);
+    assert(g_alive == 0);
+
+    // The first shard throwing skips the post constructions of the others
+    failed = throws([] { Sharded::createInstance(); });
+    assert(failed == g_fail);
+    assert(g_alive == 4);
+    Sharded::destructInstance();
+    assert(g_alive == 0);
+  }
+  printf("OK\n");
+  return 0;
+}
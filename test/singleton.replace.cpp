@@ -0,0 +1,58 @@
+#include "../singleton.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Readers check an instance that is poisoned by its destructor, while the
+// instance is replaced under them
+
+class Routes : public Singleton<Routes> {
+ public:
+  static std::atomic<int> destructed;
+
+  explicit Routes(int version) : version(version), check(version * 2) {}
+  ~Routes() {
+    check = -1;
+    destructed.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  int version;
+  int check;
+};
+std::atomic<int> Routes::destructed{0};
+
+int main() {
+  constexpr int kReplacements = 2000;
+  Routes::createInstance(0);
+
+  std::atomic<bool> done{false};
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&] {
+      int last = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        auto routes = Routes::readInstance();
+        // Never nullptr while being replaced
+        assert(routes);
+        assert(routes->check == routes->version * 2);
+        assert(routes->version >= last);
+        last = routes->version;
+      }
+    });
+  }
+
+  for (int version = 1; version <= kReplacements; ++version)
+    Routes::replaceInstance(version);
+  done.store(true, std::memory_order_relaxed);
+  for (auto &reader : readers) reader.join();
+
+  assert(Routes::destructed.load() == kReplacements);
+  assert(Routes::getInstance()->version == kReplacements);
+  Routes::destructInstance();
+
+  puts("OK");
+  return 0;
+}
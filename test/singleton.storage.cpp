@@ -0,0 +1,85 @@
+#include "../singleton.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+// Instances are allocated and freed by the storage policy of their traits:
+// in place inside their helper, or on the heap through the aligned operator
+// new and delete
+
+int g_aligned_news = 0;
+int g_aligned_deletes = 0;
+void *g_last_new = nullptr;
+void *g_last_delete = nullptr;
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  std::size_t align = static_cast<std::size_t>(alignment);
+  void *pointer = std::aligned_alloc(align, (size + align - 1) / align * align);
+  if (pointer == nullptr) throw std::bad_alloc();
+  ++g_aligned_news;
+  g_last_new = pointer;
+  return pointer;
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept {
+  ++g_aligned_deletes;
+  g_last_delete = pointer;
+  std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept {
+  operator delete(pointer, std::align_val_t{});
+}
+
+int g_destructions = 0;
+
+class alignas(64) InPlace : public Singleton<InPlace> {
+ public:
+  explicit InPlace(int value) : value(value) {}
+  ~InPlace() { ++g_destructions; }
+
+  int value;
+};
+
+template <>
+struct SingletonTraits<InPlace> : SingletonDefaultTraits {
+  using storage = SingletonInPlaceStorage;
+};
+
+class alignas(64) OnHeap : public Singleton<OnHeap> {
+ public:
+  explicit OnHeap(int value) : value(value) {}
+  ~OnHeap() { ++g_destructions; }
+
+  int value;
+};
+
+int main() {
+  // Rebuilt in the same storage, without touching the heap
+  InPlace *first = InPlace::createInstance(1);
+  assert(reinterpret_cast<std::uintptr_t>(first) % 64 == 0);
+  InPlace::destructInstance();
+  assert(g_destructions == 1 && InPlace::tryGetInstance() == nullptr);
+  InPlace *second = InPlace::createInstance(2);
+  assert(second == first && second->value == 2);
+  InPlace::destructInstance();
+  assert(g_destructions == 2);
+  assert(g_aligned_news == 0 && g_aligned_deletes == 0);
+
+  // Freed by the aligned delete matching its allocation
+  for (int round = 1; round <= 2; ++round) {
+    OnHeap *instance = OnHeap::createInstance(round);
+    assert(reinterpret_cast<std::uintptr_t>(instance) % 64 == 0);
+    assert(instance == g_last_new && instance->value == round);
+    OnHeap::destructInstance();
+    assert(g_last_delete == instance);
+    assert(g_aligned_news == round && g_aligned_deletes == round);
+  }
+  assert(g_destructions == 4);
+
+  puts("OK");
+  return 0;
+}
@@ -0,0 +1,46 @@
+#include "../singleton.h"
+
+#include <cassert>
+#include <cstdio>
+#include <thread>
+
+// Cached lookups see each new instance of their type, and aren't invalidated
+// by the other types
+
+int g_generation = 0;
+
+class Cached : public Singleton<Cached> {
+ public:
+  int generation = ++g_generation;
+};
+
+template <>
+struct SingletonTraits<Cached> : SingletonDefaultTraits {
+  static constexpr bool thread_cached = true;
+};
+
+class Other : public Singleton<Other> {};
+
+int main() {
+  Cached::createInstance();
+  assert(Cached::getInstance()->generation == 1);
+  std::thread([] { assert(Cached::getInstance()->generation == 1); }).join();
+
+  Cached::destructInstance();
+  Cached::createInstance();
+  assert(Cached::getInstance()->generation == 2);
+  std::thread([] { assert(Cached::getInstance()->generation == 2); }).join();
+
+  // Other types don't touch the epoch of Cached
+  unsigned long long epoch = SingletonTypeEpoch<Cached>::current();
+  for (int i = 0; i < 100; ++i) {
+    Other::createInstance();
+    Other::destructInstance();
+  }
+  assert(SingletonTypeEpoch<Cached>::current() == epoch);
+  assert(Cached::getInstance()->generation == 2);
+
+  Cached::destructInstance();
+  puts("OK");
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include "../singleton_arena.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Slots are packed on cache lines, reused across rebuilds, and the types not
+// fitting fall back to the heap
+
+class Small : public Singleton<Small> {
+ public:
+  Small() {}
+  char data[100];
+};
+
+class Medium : public Singleton<Medium> {
+ public:
+  Medium() {}
+  char data[1000];
+};
+
+class Big : public Singleton<Big> {
+ public:
+  Big() {}
+  char data[8192];
+};
+
+class Overflow : public SingletonHook {
+ public:
+  void onEvent(SingletonEvent event, const std::type_info &type,
+               const void *instance) override {
+    if (event != SingletonEvent::kArenaOverflow) return;
+    assert(type == typeid(Big));
+    count++;
+    memory = instance;
+  }
+  int count = 0;
+  const void *memory = nullptr;
+};
+
+template <>
+struct SingletonTraits<Small> : SingletonDefaultTraits {
+  using storage = SingletonArenaStorage;
+};
+
+template <>
+struct SingletonTraits<Medium> : SingletonDefaultTraits {
+  using storage = SingletonArenaStorage;
+};
+
+template <>
+struct SingletonTraits<Big> : SingletonDefaultTraits {
+  using storage = SingletonArenaStorage;
+};
+
+int main() {
+  bool configured = SingletonArena::configure(4096, 0);
+  assert(configured);
+
+  Overflow overflow;
+  SingletonHooks::install(&overflow);
+  Small *small = Small::createInstance();
+  Medium *medium = Medium::createInstance();
+  Big *big = Big::createInstance();
+  configured = SingletonArena::configure(8192, 0);
+  assert(!configured);
+  // Big is reported once, when its heap slot is allocated
+  assert(overflow.count == 1 && overflow.memory == big);
+
+  auto entries = SingletonArena::entries();
+  assert(entries.size() == 2);
+  assert(*entries[0].type == typeid(Small) && entries[0].offset == 0);
+  assert(*entries[1].type == typeid(Medium) && entries[1].offset == 128);
+  assert(reinterpret_cast<unsigned char *>(medium) -
+             reinterpret_cast<unsigned char *>(small) ==
+         128);
+  assert(reinterpret_cast<std::uintptr_t>(small) %
+             SINGLETON_CACHE_LINE_SIZE ==
+         0);
+  assert(SingletonArena::footprint() == 128 + sizeof(Medium));
+
+  // Rebuilt in the same slot, without growing the arena
+  Small::destructInstance();
+  Small *rebuilt = Small::createInstance();
+  assert(rebuilt == small);
+  Big::destructInstance();
+  Big *reallocated = Big::createInstance();
+  assert(reallocated == big);
+  assert(overflow.count == 1);
+  SingletonHooks::install(nullptr);
+  assert(SingletonArena::footprint() == 128 + sizeof(Medium));
+  assert(SingletonArena::entries().size() == 2);
+
+  FILE *file = tmpfile();
+  SingletonArena::report(file);
+  rewind(file);
+  std::string report;
+  char buffer[256];
+  while (fgets(buffer, sizeof(buffer), file) != nullptr) report += buffer;
+  fclose(file);
+  fputs(report.c_str(), stdout);
+  snprintf(buffer, sizeof(buffer), "%zu of 4096 bytes used, normal pages",
+           128 + sizeof(Medium));
+  assert(report.find(buffer) != std::string::npos);
+  snprintf(buffer, sizeof(buffer), "%10d %10zu  Medium", 128, sizeof(Medium));
+  assert(report.find(buffer) != std::string::npos);
+  snprintf(buffer, sizeof(buffer), "%10s %10zu  Big", "heap", sizeof(Big));
+  assert(report.find(buffer) != std::string::npos);
+
+  Big::destructInstance();
+  Medium::destructInstance();
+  Small::destructInstance();
+  return 0;
+}
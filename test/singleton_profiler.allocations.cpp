@@ -0,0 +1,47 @@
+// Built in place of singleton_profiler.cpp, with the allocations counted
+#define SINGLETON_PROFILE_ALLOCATIONS
+#include "../singleton_profiler.cpp"
+
+#include <cassert>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+struct alignas(64) Block {
+  char data[64];
+};
+
+class Buffers : public Singleton<Buffers> {
+ public:
+  Buffers() : m_values(16), m_block(new Block) {}
+
+ private:
+  std::vector<int> m_values;
+  std::unique_ptr<Block> m_block;
+};
+
+class Empty : public Singleton<Empty> {};
+
+int main() {
+  SingletonProfiler profiler;
+  SingletonHooks::install(&profiler);
+  Buffers::createInstance();
+  Empty::createInstance();
+  SingletonHooks::install(nullptr);
+
+  // The vector and the over-aligned block
+  long long buffers = -1;
+  long long empty = -1;
+  for (const SingletonProfiler::Span &span : profiler.spans()) {
+    if (span.kind != SingletonEvent::kConstructBegin) continue;
+    if (*span.type == typeid(Buffers)) buffers = span.allocations;
+    if (*span.type == typeid(Empty)) empty = span.allocations;
+  }
+  assert(buffers == 2);
+  assert(empty == 0);
+
+  Empty::destructInstance();
+  Buffers::destructInstance();
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,140 @@
+#include "../singleton_profiler.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+class Inner : public Singleton<Inner> {};
+
+class Outer : public Singleton<Outer> {
+ public:
+  Outer() { Inner::createInstance(); }
+  void postConstruction() override { Inner::getInstance(); }
+};
+
+class Faulty : public Singleton<Faulty> {
+ public:
+  Faulty() { throw std::runtime_error("faulty"); }
+};
+
+class Leaf : public Singleton<Leaf> {};
+
+class Tolerant : public Singleton<Tolerant> {
+ public:
+  Tolerant() {
+    try {
+      Faulty::createInstance();
+    } catch (const std::runtime_error &) {
+    }
+    Leaf::createInstance();
+  }
+};
+
+class Later : public Singleton<Later> {};
+
+const SingletonProfiler::Span *find(
+    const std::vector<SingletonProfiler::Span> &spans,
+    const std::type_info &type, SingletonEvent kind) {
+  const SingletonProfiler::Span *found = nullptr;
+  for (const SingletonProfiler::Span &span : spans) {
+    if (*span.type != type || span.kind != kind) continue;
+    assert(found == nullptr);
+    found = &span;
+  }
+  return found;
+}
+
+std::string contents(FILE *file) {
+  std::string text;
+  rewind(file);
+  char buffer[256];
+  while (fgets(buffer, sizeof buffer, file)) text += buffer;
+  fclose(file);
+  return text;
+}
+
+std::size_t count(const std::string &text, const char *pattern) {
+  std::size_t found = 0;
+  for (std::size_t at = text.find(pattern); at != std::string::npos;
+       at = text.find(pattern, at + 1))
+    found++;
+  return found;
+}
+
+int main() {
+  SingletonProfiler profiler;
+  SingletonHooks::install(&profiler);
+  Outer::createInstance();
+  Tolerant::createInstance();
+  Later::createInstance();
+  SingletonHooks::install(nullptr);
+
+  // Spans are paired with their begin and nested by the constructions in
+  // progress
+  std::vector<SingletonProfiler::Span> spans = profiler.spans();
+  const SingletonEvent construct = SingletonEvent::kConstructBegin;
+  const SingletonEvent post = SingletonEvent::kPostConstructionBegin;
+  const SingletonProfiler::Span *inner = find(spans, typeid(Inner), construct);
+  const SingletonProfiler::Span *outer = find(spans, typeid(Outer), construct);
+  assert(inner != nullptr && inner->depth == 1);
+  assert(outer != nullptr && outer->depth == 0);
+  assert(inner->start >= outer->start);
+  assert(inner->start + inner->wall <= outer->start + outer->wall);
+  assert(find(spans, typeid(Outer), post) != nullptr);
+  assert(find(spans, typeid(Inner), post) != nullptr);
+
+  // The failed construction leaves no span, nor changes the depth of the
+  // later ones
+  assert(find(spans, typeid(Faulty), construct) == nullptr);
+  assert(find(spans, typeid(Leaf), construct)->depth == 1);
+  assert(find(spans, typeid(Tolerant), construct)->depth == 0);
+  assert(find(spans, typeid(Later), construct)->depth == 0);
+  for (const SingletonProfiler::Span &span : spans) {
+    assert(span.thread == spans.front().thread);
+    assert(span.wall >= 0);
+  }
+
+  // 5 constructions and 5 post constructions
+  assert(spans.size() == 10);
+  FILE *trace = tmpfile();
+  profiler.writeChromeTrace(trace);
+  std::string json = contents(trace);
+  assert(json.compare(0, 16, "{\"traceEvents\":[") == 0);
+  assert(json.find("\n],\"displayTimeUnit\":\"ms\"}\n") ==
+         json.size() - strlen("\n],\"displayTimeUnit\":\"ms\"}\n"));
+  assert(count(json, "\"ph\":\"X\"") == 10);
+  assert(count(json, "\"cat\":\"construct\"") == 5);
+  assert(count(json, "\"cat\":\"postConstruction\"") == 5);
+  assert(count(json, "\"depth\":1}") == 2);
+  assert(count(json, "Faulty") == 0);
+
+  FILE *summary = tmpfile();
+  profiler.printSummary(summary);
+  std::string table = contents(summary);
+  printf("%s", table.c_str());
+  assert(table.compare(0, 12, "   wall (ms)") == 0);
+  // A header and a line per type
+  assert(count(table, "\n") == 6);
+  for (const char *name : {"Inner", "Outer", "Tolerant", "Leaf", "Later"}) {
+    std::size_t at = table.find(name);
+    assert(at != std::string::npos);
+    // Constructed once each
+    std::size_t line = table.rfind('\n', at) + 1;
+    int constructions = 0;
+    int depth = -1;
+    assert(sscanf(table.c_str() + line, "%*f %*f %*f %*d %d %d",
+                  &constructions, &depth) == 2);
+    assert(constructions == 1);
+    assert(depth == (!strcmp(name, "Inner") || !strcmp(name, "Leaf")));
+  }
+
+  Later::destructInstance();
+  Leaf::destructInstance();
+  Tolerant::destructInstance();
+  Inner::destructInstance();
+  Outer::destructInstance();
+  printf("OK\n");
+  return 0;
+}
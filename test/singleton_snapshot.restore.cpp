@@ -0,0 +1,108 @@
+#include "../singleton_snapshot.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Restores a derived table from its image, and rebuilds it once the image is
+// corrupted
+
+class Squares : public Singleton<Squares> {
+ public:
+  static int builds;
+
+  explicit Squares(std::size_t count) : m_owned(count) {
+    ++builds;
+    for (std::size_t i = 0; i < count; ++i) m_owned[i] = i * i;
+    m_count = count;
+    m_table = m_owned.data();
+  }
+  explicit Squares(const SingletonSnapshotView &view)
+      : m_count(*view.read<std::size_t>()),
+        m_table(view.read<std::uint64_t>(m_count)) {}
+
+  bool saveSnapshot(SingletonSnapshotWriter &writer) const override {
+    writer.write(&m_count);
+    writer.write(m_table, m_count);
+    return true;
+  }
+
+  std::size_t count() const { return m_count; }
+  const std::uint64_t *table() const { return m_table; }
+
+ private:
+  std::vector<std::uint64_t> m_owned;
+  std::size_t m_count;
+  const std::uint64_t *m_table;
+};
+int Squares::builds = 0;
+
+class Rejections : public SingletonHook {
+ public:
+  void onEvent(SingletonEvent event, const std::type_info &type,
+               const void *instance) override {
+    if (event != SingletonEvent::kSnapshotRejected) return;
+    assert(type == typeid(Squares) && instance == nullptr);
+    count++;
+  }
+  int count = 0;
+};
+
+template <>
+struct SingletonTraits<Squares> : SingletonDefaultTraits {
+  static constexpr unsigned snapshot_version = 1;
+};
+
+int main() {
+  char directory[] = "/tmp/singleton_snapshot.XXXXXX";
+  char *created = mkdtemp(directory);
+  assert(created != nullptr);
+  Rejections rejections;
+  SingletonHooks::install(&rejections);
+
+  // Disabled until a directory is set
+  Squares::createInstance(1000);
+  bool saved = SingletonSnapshot::save<Squares>();
+  assert(!saved);
+  Squares::destructInstance();
+
+  SingletonSnapshot::setDirectory(directory);
+  Squares::createInstance(1000);
+  assert(Squares::builds == 2);
+  saved = SingletonSnapshot::save<Squares>();
+  assert(saved);
+  Squares::destructInstance();
+
+  Squares::createInstance(1000);
+  assert(Squares::builds == 2);
+  assert(Squares::getInstance()->count() == 1000);
+  assert(Squares::getInstance()->table()[999] == 999 * 999);
+  assert(rejections.count == 0 && SingletonSnapshot::rejection() == nullptr);
+  Squares::destructInstance();
+
+  // Flip a byte of the state
+  std::string path = SingletonSnapshot::path(typeid(Squares));
+  FILE *file = fopen(path.c_str(), "r+b");
+  assert(file != nullptr);
+  fseek(file, -1, SEEK_END);
+  int last = fgetc(file);
+  fseek(file, -1, SEEK_END);
+  fputc(last ^ 1, file);
+  fclose(file);
+
+  Squares::createInstance(10);
+  assert(Squares::builds == 3);
+  assert(Squares::getInstance()->count() == 10);
+  assert(rejections.count == 1);
+  assert(strcmp(SingletonSnapshot::rejection(), "corrupted") == 0);
+  SingletonHooks::install(nullptr);
+  Squares::destructInstance();
+
+  remove(path.c_str());
+  remove(directory);
+  puts("OK");
+  return 0;
+}
@@ -0,0 +1,29 @@
+#include "../singleton_tracer.h"
+
+#include <cassert>
+#include <cstdio>
+
+class Inner : public Singleton<Inner> {};
+
+class Outer : public Singleton<Outer> {
+ public:
+  Outer() { Inner::createInstance(); }
+  void postConstruction() override { Inner::getInstance(); }
+};
+
+int main() {
+  SingletonRingTracer tracer(8);
+  SingletonHooks::install(&tracer);
+  Outer::createInstance();
+  Inner::destructInstance();
+  Outer::destructInstance();
+  SingletonHooks::install(nullptr);
+
+  // 4 construction, 4 post construction and 4 destruction events, of which
+  // the latest 8 are kept
+  printf("%llu events recorded\n",
+         static_cast<unsigned long long>(tracer.recorded()));
+  assert(tracer.recorded() == 12);
+  tracer.dump(stdout);
+  return 0;
+}
@@ -0,0 +1,102 @@
+#include "../thread_local_singleton.h"
+
+#include <atomic>
+#include <cassert>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+class Stats : public ThreadLocalSingleton<Stats> {
+ public:
+  std::atomic<long> requests{0};
+};
+
+class alignas(128) Padded : public ThreadLocalSingleton<Padded> {
+ public:
+  long value = 0;
+};
+
+bool g_post_constructed = false;
+
+class Faulty : public ThreadLocalSingleton<Faulty> {
+ public:
+  explicit Faulty(bool fail) {
+    if (fail) throw std::runtime_error("fail");
+  }
+  void postConstruction() override { g_post_constructed = true; }
+};
+
+int g_depth = 0;
+
+// Uses its own instance during construction, which would build a new one on
+// each level
+class Recursive : public ThreadLocalSingleton<Recursive> {
+ public:
+  Recursive() {
+    if (++g_depth < 6) Recursive::getInstance();
+  }
+};
+
+int main() {
+  constexpr int kThreads = 4;
+  constexpr long kRequests = 100000;
+  std::atomic<int> finished{0};
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> workers;
+  for (int t = 0; t < kThreads; ++t)
+    workers.emplace_back([&] {
+      for (long i = 0; i < kRequests; ++i)
+        Stats::getInstance()->requests.fetch_add(1, std::memory_order_relaxed);
+      finished++;
+      while (!stop) std::this_thread::yield();
+    });
+  while (finished != kThreads) std::this_thread::yield();
+
+  long total = 0;
+  Stats::forEachInstance([&](Stats *stats) { total += stats->requests; });
+  printf("%zu instances, %ld requests\n", Stats::instanceCount(), total);
+  assert(Stats::instanceCount() == kThreads);
+  assert(total == kThreads * kRequests);
+
+  stop = true;
+  for (auto &worker : workers) worker.join();
+  printf("%zu instances after join\n", Stats::instanceCount());
+  assert(Stats::instanceCount() == 0);
+
+  Stats::getInstance()->requests++;
+  assert(Stats::peekInstance()->requests == 1);
+  Stats::destructInstance();
+  assert(Stats::peekInstance() == nullptr);
+
+  assert(reinterpret_cast<std::uintptr_t>(Padded::getInstance()) % 128 == 0);
+  Padded::destructInstance();
+
+  // A failed construction leaves the post constructions of the thread running
+  try {
+    Faulty::createInstance(true);
+    assert(false);
+  } catch (const std::runtime_error &) {
+  }
+  assert(Faulty::peekInstance() == nullptr);
+  Faulty::createInstance(false);
+  assert(g_post_constructed);
+  Faulty::destructInstance();
+
+#ifndef NDEBUG
+  // Asserts on the first recursion
+  pid_t pid = fork();
+  if (pid == 0) {
+    Recursive::getInstance();
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+#endif
+  return 0;
+}
@@ -0,0 +1,199 @@
+/**
+ * @file thread_local_singleton.h
+ * @author H1MSK (ksda47832338@outlook.com)
+ * @brief Singleton variant holding one instance per thread
+ * @version 0.5
+ * @date 2022-06-26
+ */
+
+#ifndef THREAD_LOCAL_SINGLETON_H
+#define THREAD_LOCAL_SINGLETON_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include "singleton.h"
+
+/**
+ * @brief Singleton class whose instance is private to each thread
+ *
+ * @tparam Type Type of the class
+ *
+ * Each thread lazily constructs its own instance on the first call of
+ * @ref getInstance, or explicitly through @ref createInstance. Lookups and
+ * construction never lock; only the registry of live instances, used by
+ * @ref forEachInstance, is locked when an instance is added or removed.
+ *
+ * The instance of a thread is destructed when the thread exits.
+ *
+ * ```cpp
+ * #include "thread_local_singleton.h"
+ *
+ * class Stats : public ThreadLocalSingleton<Stats> {
+ *  public:
+ *   long requests = 0;
+ * };
+ *
+ * // In workers
+ * Stats::getInstance()->requests++;
+ *
+ * // Aggregation
+ * long total = 0;
+ * Stats::forEachInstance([&](Stats *stats) { total += stats->requests; });
+ * ```
+ */
+template <typename Type>
+class ThreadLocalSingleton : public SingletonBase {
+ public:
+  /**
+   * @brief Create the instance of Type for current thread
+   *
+   * @tparam ConstructorArguments Argument types for construction
+   * @param args Arguments for construction, forwarded to the constructor
+   * @return Type* Pointer to the instance of current thread
+   */
+  template <typename... ConstructorArguments>
+  static Type *createInstance(ConstructorArguments &&...args) {
+    assert(t_instance == nullptr);
+    // Created again from its own constructor, which would recurse forever
+    assert(t_building == nullptr);
+    Type *data = static_cast<Type *>(
+        ::operator new(sizeof(Type), std::align_val_t(alignof(Type))));
+    t_building = data;
+    SingletonLifetime::construct(
+        data,
+        [&](Type *data) {
+          new (data) Type(std::forward<ConstructorArguments>(args)...);
+        },
+        [](Type *data) {
+          t_building = nullptr;
+          ::operator delete(data, std::align_val_t(alignof(Type)));
+        });
+    t_building = nullptr;
+    t_instance = data;
+    t_reaper.armed = true;
+    Registry *registry = Registry::Get();
+    {
+      std::lock_guard<std::mutex> lock(registry->mutex);
+      registry->instances.push_back(data);
+    }
+    SingletonPostConstructionHelper::pop();
+    return data;
+  }
+
+  /**
+   * @brief Get the instance of current thread, constructing it with default
+   * constructor on need
+   *
+   * @return Type* Pointer to the instance of current thread
+   *
+   * @note
+   * Asserts when called from the constructor of Type, see @ref PointerWrapper
+   * for the solutions
+   */
+  static Type *getInstance() {
+    Type *pointer = t_instance;
+    if (pointer == nullptr) pointer = createInstance();
+    return pointer;
+  }
+
+  /**
+   * @brief Get the instance of current thread without constructing it
+   *
+   * @return Type* Pointer to the instance of current thread, or nullptr
+   */
+  static Type *peekInstance() { return t_instance; }
+
+  /**
+   * @brief Destruct the instance of current thread ahead of thread exit
+   */
+  static void destructInstance() {
+    Type *pointer = t_instance;
+    assert(pointer != nullptr);
+    Registry *registry = Registry::Get();
+    {
+      std::lock_guard<std::mutex> lock(registry->mutex);
+      auto itr = std::find(registry->instances.begin(),
+                           registry->instances.end(), pointer);
+      assert(itr != registry->instances.end());
+      registry->instances.erase(itr);
+    }
+    t_instance = nullptr;
+    SingletonLifetime::destruct(pointer);
+    ::operator delete(pointer, std::align_val_t(alignof(Type)));
+  }
+
+  /**
+   * @brief Call function on every live instance of all threads
+   *
+   * @tparam Function Callable type accepting Type*
+   * @param function Function to call
+   *
+   * @note
+   * Instances can't be added or removed while iterating, but their owning
+   * threads keep running, so the instances should be read in a thread safe
+   * way, like through atomics.
+   */
+  template <typename Function>
+  static void forEachInstance(Function function) {
+    Registry *registry = Registry::Get();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    for (Type *pointer : registry->instances) function(pointer);
+  }
+
+  /**
+   * @brief Get the count of live instances of all threads
+   */
+  static std::size_t instanceCount() {
+    Registry *registry = Registry::Get();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    return registry->instances.size();
+  }
+
+ private:
+  struct Registry {
+    std::mutex mutex;
+    std::vector<Type *> instances;
+
+    static Registry *Get() {
+      static Registry registry;
+      return &registry;
+    }
+  };
+
+  /**
+   * @brief Destructs the instance of its thread on thread exit
+   *
+   * Separated from @ref t_instance so that lookups stay a plain thread_local
+   * load without the initialization guard of a non-trivial thread_local
+   */
+  struct Reaper {
+    bool armed = false;
+    ~Reaper() {
+      if (armed && t_instance != nullptr) destructInstance();
+    }
+  };
+
+  static thread_local Type *t_instance;
+  // Instance of current thread under construction
+  static thread_local Type *t_building;
+  static thread_local Reaper t_reaper;
+};
+
+template <typename Type>
+thread_local Type *ThreadLocalSingleton<Type>::t_instance = nullptr;
+
+template <typename Type>
+thread_local Type *ThreadLocalSingleton<Type>::t_building = nullptr;
+
+template <typename Type>
+thread_local typename ThreadLocalSingleton<Type>::Reaper
+    ThreadLocalSingleton<Type>::t_reaper;
+
+#endif  // THREAD_LOCAL_SINGLETON_H